@@ -0,0 +1,492 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "JuceHeader.h"
+
+#include "../Source/ApplicationState.h"
+#include "../Source/CompiledProgram.h"
+#include "../Source/HexDecoder.h"
+#include "../Source/LineTokenizer.h"
+
+// Measures the throughput of the command pipeline, from tokenizing a line to
+// the MIDI messages it produces, without opening a MIDI port: the messages
+// are collected in memory or compiled to a temporary file. Next to that come
+// the device lookups and the port output, which create virtual ports and are
+// left out where that isn't possible. Where a hot path was reworked, the way
+// it was is measured too, under a name of its own. The results are printed
+// as JSON, so that they can be compared between versions:
+//
+//   SendMIDIBenchmarks [name ...] > results.json
+//
+// Only the benchmarks whose names contain one of the arguments are run.
+
+// throws away what the commands print while they're measured, so that only
+// the results go to the standard output
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+};
+
+class BenchmarkRunnerApplication : public JUCEApplicationBase
+{
+public:
+    const String getApplicationName() override       { return "SendMIDIBenchmarks"; }
+    const String getApplicationVersion() override    { return ProjectInfo::versionString; }
+    bool moreThanOneInstanceAllowed() override       { return true; }
+    void systemRequestedQuit() override              { quit(); }
+
+    void initialise(const String& commandLine) override
+    {
+        filter_.addTokens(commandLine, true);
+        filter_.removeEmptyStrings();
+
+        NullBuffer discard;
+        auto* out = std::cout.rdbuf(&discard);
+
+        benchmarkTokenizer();
+        benchmarkCommandLookup();
+        benchmarkColdStart();
+        benchmarkDeviceLookup();
+        benchmarkPortOutput();
+        benchmarkNoteNames();
+        benchmarkPanic();
+        benchmarkMpeTest();
+        benchmarkSysEx();
+        benchmarkHexBlob();
+
+        std::cout.rdbuf(out);
+
+        DynamicObject::Ptr report = new DynamicObject();
+        report->setProperty("version", ProjectInfo::versionString);
+        report->setProperty("benchmarks", results_);
+        std::cout << JSON::toString(report.get(), false) << std::endl;
+
+        quit();
+    }
+
+    void shutdown() override {}
+    void suspended() override {}
+    void resumed() override {}
+    void anotherInstanceStarted(const String&) override {}
+    void unhandledException(const std::exception*, const String&, int) override { jassertfalse; }
+
+private:
+    static constexpr double MINIMUM_SECONDS = 0.5;
+
+    bool isSelected(const String& name) const
+    {
+        if (filter_.isEmpty())
+        {
+            return true;
+        }
+        for (auto&& f : filter_)
+        {
+            if (name.containsIgnoreCase(f))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // runs a round over and over until it took long enough to measure, a
+    // round returns how many units it processed; the first round warms up
+    // and isn't counted
+    template <typename Round>
+    void measure(const String& name, const String& unit, Round&& round)
+    {
+        if (!isSelected(name))
+        {
+            return;
+        }
+
+        round();
+
+        int64 rounds = 0;
+        int64 units = 0;
+        double seconds = 0.0;
+        auto start = Time::getHighResolutionTicks();
+        do
+        {
+            units += round();
+            rounds += 1;
+            seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+        }
+        while (seconds < MINIMUM_SECONDS);
+
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty("name", name);
+        result->setProperty("unit", unit + "/s");
+        result->setProperty("value", (double)units / seconds);
+        result->setProperty("rounds", rounds);
+        result->setProperty(unit, units);
+        result->setProperty("seconds", seconds);
+        results_.add(result.get());
+    }
+
+    void benchmarkTokenizer()
+    {
+        String program("# a line of a typical program\n"
+                       "ch 1 on 60 100 cc 74 55 off 60 0 pb 8192 syx 43 10 4C 00 00 7E 00 "
+                       "\"quoted token\" control-change 1 2 nrpn 245 1 +0.5 on C4 127\n");
+        for (int i = 0; i < 4; ++i)
+        {
+            program += program;
+        }
+
+        // the tokenizer terminates the tokens in place, so every round gets a
+        // fresh copy of the lines
+        std::vector<char> text(program.toRawUTF8(), program.toRawUTF8() + program.getNumBytesAsUTF8() + 1);
+        std::vector<char> line(text.size());
+        measure("tokenize", "tokens", [&]
+        {
+            std::memcpy(line.data(), text.data(), text.size());
+            int64 tokens = 0;
+            for (char* start = line.data(); start != nullptr; )
+            {
+                auto* end = std::strchr(start, '\n');
+                if (end != nullptr)
+                {
+                    *end = 0;
+                }
+                LineTokenizer tokenizer(start);
+                while (tokenizer.next() != nullptr)
+                {
+                    tokens += 1;
+                }
+                start = end != nullptr ? end + 1 : nullptr;
+            }
+            return tokens;
+        });
+    }
+
+    void benchmarkCommandLookup()
+    {
+        ApplicationState state;
+        StringArray tokens;
+        tokens.addTokens("ch 1 on 60 100 cc 74 55 off 60 0 control-change 1 2 pb 8192 "
+                         "syx 43 10 4C nrpn 245 1 raw-midi 144 60 100 mpetest", false);
+        int64 results = 0;
+        measure("command-lookup", "tokens", [&]
+        {
+            for (auto&& token : tokens)
+            {
+                results += state.findApplicationCommand(token) != nullptr;
+            }
+            return (int64)tokens.size();
+        });
+
+        // the lookup as it was: both names of every command compared in turn
+        measure("command-lookup-scan", "tokens", [&]
+        {
+            for (auto&& token : tokens)
+            {
+                for (auto&& cmd : state.getCommands())
+                {
+                    if (cmd.param_.equalsIgnoreCase(token) || cmd.altParam_.equalsIgnoreCase(token))
+                    {
+                        results += 1;
+                        break;
+                    }
+                }
+            }
+            return (int64)tokens.size();
+        });
+        keepAlive_ += results;
+    }
+
+    void benchmarkColdStart()
+    {
+        measure("cold-start", "starts", [&]
+        {
+            ApplicationState state;
+            return (int64)1;
+        });
+
+        // as it was: every state set up a MIDI-CI device in its constructor
+        measure("cold-start-eager", "starts", [&]
+        {
+            ApplicationState state;
+            MpeProfileNegotiation mpe(&state);
+            return (int64)1;
+        });
+    }
+
+    void benchmarkDeviceLookup()
+    {
+        // 200 ports, with every name shared by two of them
+        Array<MidiDeviceInfo> devices;
+        for (int i = 0; i < 200; ++i)
+        {
+            devices.add({"Virtual " + String(i % 100), "id" + String(i)});
+        }
+        auto names = DeviceRegistry::displayNames(devices);
+
+        DeviceRegistry registry(DeviceRegistry::OUTPUTS);
+        registry.setDevices(devices);
+        int64 results = 0;
+        measure("device-lookup", "lookups", [&]
+        {
+            for (auto&& name : names)
+            {
+                results += registry.find(name);
+            }
+            return (int64)names.size();
+        });
+
+        // the display names as they were: every port compared with every
+        // other, over again for every lookup
+        measure("device-lookup-rematch", "lookups", [&]
+        {
+            for (auto&& name : names)
+            {
+                StringArray rematched;
+                for (int i = 0; i < devices.size(); ++i)
+                {
+                    int total = 0;
+                    int position = 1;
+                    for (int j = 0; j < devices.size(); ++j)
+                    {
+                        if (devices[j].name == devices[i].name)
+                        {
+                            total += 1;
+                            position += j < i;
+                        }
+                    }
+                    rematched.add(total > 1 ? devices[i].name + " (" + String(position) + ")" : devices[i].name);
+                }
+                results += rematched.indexOf(name);
+            }
+            return (int64)names.size();
+        });
+        keepAlive_ += results;
+
+        // the same with 200 real virtual ports, where listing them walks
+        // every client and port of the system
+        if (!isSelected("device-lookup-system"))
+        {
+            return;
+        }
+        struct Ignore : public MidiInputCallback
+        {
+            void handleIncomingMidiMessage(MidiInput*, const MidiMessage&) override {}
+        } ignore;
+        std::vector<std::unique_ptr<MidiInput>> ports;
+        for (int i = 0; i < 200; ++i)
+        {
+            auto port = MidiInput::createNewDevice("SendMIDI Benchmark " + String(i), &ignore);
+            if (port == nullptr)
+            {
+                return;
+            }
+            ports.push_back(std::move(port));
+        }
+
+        DeviceRegistry system(DeviceRegistry::OUTPUTS);
+        system.getDevices();
+        measure("device-lookup-system", "lookups", [&]
+        {
+            for (int i = 0; i < 200; ++i)
+            {
+                results += system.find("SendMIDI Benchmark " + String(i));
+            }
+            return (int64)200;
+        });
+
+        // as it was: the ports listed for every lookup
+        measure("device-lookup-system-listed", "lookups", [&]
+        {
+            for (int i = 0; i < 200; ++i)
+            {
+                results += ApplicationState::matchDeviceIndex(MidiOutput::getAvailableDevices(),
+                                                              "SendMIDI Benchmark " + String(i));
+            }
+            return (int64)200;
+        });
+        keepAlive_ += results;
+    }
+
+    // the messages of a panic, all notes off on every channel, sent to a
+    // virtual port; nothing has to be connected to it for the output path to
+    // be measured
+    void benchmarkPortOutput()
+    {
+        if (!isSelected("port-output"))
+        {
+            return;
+        }
+        auto out = MidiOutput::createNewDevice("SendMIDI Benchmark");
+        if (out == nullptr)
+        {
+            return;
+        }
+
+        MidiBuffer panic;
+        for (int ch = 1; ch <= 16; ++ch)
+        {
+            for (int note = 0; note < 128; ++note)
+            {
+                panic.addEvent(MidiMessage::noteOff(ch, note), 0);
+            }
+        }
+
+        measure("port-output-blocks", "messages", [&]
+        {
+            out->sendBlockOfMessagesNow(panic);
+            return (int64)panic.getNumEvents();
+        });
+
+        // as it was: one message at a time
+        measure("port-output-single", "messages", [&]
+        {
+            for (const auto metadata : panic)
+            {
+                out->sendMessageNow(metadata.getMessage());
+            }
+            return (int64)panic.getNumEvents();
+        });
+    }
+
+    void benchmarkNoteNames()
+    {
+        ApplicationState state;
+        StringArray tokens;
+        tokens.addTokens("C4 c#3 Db-1 E5 F#2 Gb7 G9 A0 Bb3 H4 60 127 0 B-2", false);
+        int64 results = 0;
+        measure("note-names", "tokens", [&]
+        {
+            for (auto&& token : tokens)
+            {
+                results += state.asNoteNumber(token);
+            }
+            return (int64)tokens.size();
+        });
+        keepAlive_ += results;
+    }
+
+    void benchmarkPanic()
+    {
+        ApplicationState state;
+        measure("panic", "messages", [&]
+        {
+            return (int64)state.collectLine("panic").size();
+        });
+        measure("panic-full", "messages", [&]
+        {
+            return (int64)state.collectLine("panic full").size();
+        });
+    }
+
+    // the scenario waits for more than half a minute in between its steps,
+    // so it's compiled instead of collected: the waits become delays in the
+    // program file and its messages are counted from there
+    void benchmarkMpeTest()
+    {
+        if (!isSelected("mpetest"))
+        {
+            return;
+        }
+
+        TemporaryFile program(".txt");
+        TemporaryFile compiled(".smcp");
+        if (!program.getFile().replaceWithText("mpetest\n"))
+        {
+            std::cerr << "Couldn't write \"" << program.getFile().getFullPathName() << "\"" << std::endl;
+            setApplicationReturnValue(EXIT_FAILURE);
+            return;
+        }
+
+        ApplicationState state;
+        measure("mpetest", "messages", [&]
+        {
+            state.compileFile(program.getFile(), compiled.getFile());
+            return CompiledProgram::countMessages(compiled.getFile());
+        });
+    }
+
+    void benchmarkSysEx()
+    {
+        const int bytes = 65536;
+        String line("syx");
+        for (int i = 0; i < bytes; ++i)
+        {
+            line += " " + String(i & 0x7f);
+        }
+
+        // every byte is a token of its own
+        ApplicationState state;
+        measure("syx-64k", "tokens", [&]
+        {
+            int64 size = 0;
+            for (auto&& msg : state.collectLine(line))
+            {
+                size += msg.getSysExDataSize();
+            }
+            return size;
+        });
+    }
+
+    // a patch bank of a megabyte, once as a byte per token and once as a hex
+    // blob, and the decoder on its own with and without SIMD
+    void benchmarkHexBlob()
+    {
+        const int bytes = 1 << 20;
+        std::string tokenText("hex syx");
+        std::string hex;
+        for (int i = 0; i < bytes; ++i)
+        {
+            const char digits[] = { "0123456789abcdef"[(i >> 4) & 0x7], "0123456789abcdef"[i & 0xf], 0 };
+            tokenText += " ";
+            tokenText += digits;
+            hex += digits;
+        }
+        String tokens(tokenText);
+        String blob("syx @" + hex);
+
+        ApplicationState state;
+        auto sysExSize = [&](const String& line)
+        {
+            int64 size = 0;
+            for (auto&& msg : state.collectLine(line))
+            {
+                size += msg.getSysExDataSize();
+            }
+            return size;
+        };
+        measure("syx-1m-tokens", "bytes", [&] { return sysExSize(tokens); });
+        measure("syx-1m-hex", "bytes", [&] { return sysExSize(blob); });
+
+        std::vector<uint8> out((size_t)bytes);
+        measure("hex-decode", "bytes", [&]
+        {
+            return (int64)HexDecoder::decode(hex.data(), hex.size(), out.data(), true) / 2;
+        });
+        measure("hex-decode-scalar", "bytes", [&]
+        {
+            return (int64)HexDecoder::decodeScalar(hex.data(), hex.size(), out.data(), true) / 2;
+        });
+        keepAlive_ += out[(size_t)bytes - 1];
+    }
+
+    StringArray filter_;
+    Array<var> results_;
+    std::atomic<int64> keepAlive_ { 0 };    // so that the results that aren't used are still computed
+};
+
+START_JUCE_APPLICATION (BenchmarkRunnerApplication)
@@ -109,12 +109,24 @@ MidiOutput::MidiOutput (const String& deviceName, const String& deviceIdentifier
 {
 }
 
+#if ! ((JUCE_LINUX || JUCE_BSD) && JUCE_ALSA && ! JUCE_BELA)
 void MidiOutput::sendBlockOfMessagesNow (const MidiBuffer& buffer)
 {
     for (const auto metadata : buffer)
         sendMessageNow (metadata.getMessage());
 }
 
+bool MidiOutput::waitForOutputToDrain (int)
+{
+    return false;
+}
+
+int64 MidiDeviceListConnection::getChangeCount()
+{
+    return -1;
+}
+#endif
+
 void MidiOutput::sendBlockOfMessages (const MidiBuffer& buffer,
                                       double millisecondCounterToStartAt,
                                       double samplesPerSecondForBuffer)
@@ -89,6 +89,17 @@ public:
     */
     static MidiDeviceListConnection make (std::function<void()>);
 
+    /** Returns a number that changes whenever MIDI devices are added, removed or
+        changed, or -1 on platforms that can't tell without a callback on the
+        message thread.
+
+        Unlike the callbacks, the number changes while the message thread is busy,
+        so a list of devices can be kept for as long as the number stays the same.
+        The changes are only seen while the platform's MIDI client is alive, so
+        keep a connection from make() around for as long as the number is used.
+    */
+    static int64 getChangeCount();
+
 private:
     MidiDeviceListConnection (MidiDeviceListConnectionBroadcaster* b, const Key k)
         : broadcaster (b), key (k) {}
@@ -388,6 +399,14 @@ public:
     /** Sends out a sequence of MIDI messages immediately. */
     void sendBlockOfMessagesNow (const MidiBuffer& buffer);
 
+    /** Waits until the messages that were sent have been taken out of the
+        system's output buffers, or until the timeout runs out. It may be
+        called while other threads send messages.
+
+        Returns false when it timed out, or when the platform can't tell.
+    */
+    bool waitForOutputToDrain (int timeoutMilliseconds);
+
     /** This lets you supply a block of messages that will be sent out at some point
         in the future.
 
@@ -118,6 +118,51 @@ public:
         }
 
         bool sendMessageNow (const MidiMessage& message)
+        {
+            return outputMessage (message, true);
+        }
+
+        // Queues the events in the sequencer's output buffer and drains it once,
+        // instead of making a system call for each event.
+        bool sendBlockOfMessagesNow (const MidiBuffer& buffer)
+        {
+            bool success = true;
+
+            for (const auto metadata : buffer)
+                success = outputMessage (metadata.getMessage(), false) && success;
+
+            return snd_seq_drain_output (client->get()) >= 0 && success;
+        }
+
+        // Waits for the sequencer to release the events from the client's
+        // output pool, which happens once they've been delivered to their
+        // destinations. Every send already drains the output buffer, so this
+        // leaves it alone and can run while other threads keep sending.
+        bool waitForOutputToDrain (int timeoutMilliseconds)
+        {
+            auto seqHandle = client->get();
+
+            snd_seq_client_pool_t* pool = nullptr;
+            snd_seq_client_pool_alloca (&pool);
+
+            const auto endTime = Time::getMillisecondCounter() + (uint32) jmax (0, timeoutMilliseconds);
+
+            for (;;)
+            {
+                if (snd_seq_get_client_pool (seqHandle, pool) < 0)
+                    return false;
+
+                if (snd_seq_client_pool_get_output_free (pool) >= snd_seq_client_pool_get_output_pool (pool))
+                    return true;
+
+                if (Time::getMillisecondCounter() >= endTime)
+                    return false;
+
+                Thread::sleep (1);
+            }
+        }
+
+        bool outputMessage (const MidiMessage& message, bool direct)
         {
             if (message.getRawDataSize() > maxEventSize)
             {
@@ -152,7 +197,16 @@ public:
                 snd_seq_ev_set_subs (&event);
                 snd_seq_ev_set_direct (&event);
 
-                if (snd_seq_event_output_direct (seqHandle, &event) < 0)
+                // an event that doesn't fit the output buffer, like a long SysEx,
+                // goes out directly after what's already queued
+                auto sendDirect = direct
+                               || (size_t) snd_seq_event_length (&event) >= snd_seq_get_output_buffer_size (seqHandle);
+
+                if (sendDirect && ! direct)
+                    snd_seq_drain_output (seqHandle);
+
+                if ((sendDirect ? snd_seq_event_output_direct (seqHandle, &event)
+                                : snd_seq_event_output (seqHandle, &event)) < 0)
                 {
                     success = false;
                     break;
@@ -171,6 +225,8 @@ public:
 
         void createPort (const String& name, bool enableSubscription)
         {
+            isListed = enableSubscription;
+
             if (auto seqHandle = client->get())
             {
                 const unsigned int caps =
@@ -198,6 +254,7 @@ public:
 
         int getPortId() const               { return portId; }
         const String& getPortName() const   { return portName; }
+        bool isListedAsDevice() const       { return isListed; }
 
     private:
         const std::shared_ptr<AlsaClient> client = AlsaClient::getInstance();
@@ -210,7 +267,7 @@ public:
 
         int maxEventSize = 4096, portId = -1;
         std::atomic<bool> callbackEnabled { false };
-        bool isInput = false;
+        bool isInput = false, isListed = false;
     };
 
     static std::shared_ptr<AlsaClient> getInstance()
@@ -244,6 +301,16 @@ public:
     snd_seq_t* get() const noexcept     { return handle; }
     int getId() const noexcept          { return clientId; }
 
+    // Counts the port and client changes announced by the system. The ports
+    // this client opens to connect with a device aren't listed as devices, so
+    // they're left out, and the ones that are get counted when they're created
+    // and deleted, without waiting for their announcement.
+    static std::atomic<int64>& getDeviceListChangeCount()
+    {
+        static std::atomic<int64> count { 0 };
+        return count;
+    }
+
     Port* createPort (const String& name, bool forInput, bool enableSubscription)
     {
         const ScopedLock sl (callbackLock);
@@ -255,6 +322,9 @@ public:
         jassert (iter == ports.end() || port->getPortId() < (*iter)->getPortId());
         ports.insert (iter, rawToUniquePtr (port));
 
+        if (enableSubscription)
+            ++getDeviceListChangeCount();
+
         return port;
     }
 
@@ -262,6 +332,9 @@ public:
     {
         const ScopedLock sl (callbackLock);
 
+        if (port->isListedAsDevice())
+            ++getDeviceListChangeCount();
+
         if (const auto iter = findPortIterator (port->getPortId()); iter != ports.end())
             ports.erase (iter);
     }
@@ -401,6 +474,12 @@ private:
 
                                 if (foundEvent != std::end (systemEvents))
                                 {
+                                    // subscriptions don't change which devices there are
+                                    if (inputEvent->type != SND_SEQ_EVENT_PORT_SUBSCRIBED
+                                        && inputEvent->type != SND_SEQ_EVENT_PORT_UNSUBSCRIBED
+                                        && inputEvent->data.addr.client != client.getId())
+                                        ++getDeviceListChangeCount();
+
                                     notifier.triggerAsyncUpdate();
                                     continue;
                                 }
@@ -481,6 +560,37 @@ static AlsaClient::Port* iterateMidiClient (AlsaClient& client,
     return port;
 }
 
+// The identifier of a device names its client and port, so the port to open
+// can be looked up directly instead of walking every client.
+static AlsaClient::Port* openMidiPortByIdentifier (AlsaClient& client,
+                                                   bool forInput,
+                                                   const String& deviceIdentifier)
+{
+    const auto clientPart = deviceIdentifier.upToFirstOccurrenceOf ("-", false, false);
+    const auto portPart = deviceIdentifier.fromFirstOccurrenceOf ("-", false, false);
+
+    if (clientPart.isEmpty() || ! clientPart.containsOnly ("0123456789")
+        || portPart.isEmpty() || ! portPart.containsOnly ("0123456789"))
+        return nullptr;
+
+    snd_seq_port_info_t* portInfo = nullptr;
+
+    snd_seq_port_info_alloca (&portInfo);
+    jassert (portInfo != nullptr);
+    auto sourceClient = clientPart.getIntValue();
+    auto portID = portPart.getIntValue();
+
+    if (snd_seq_get_any_port_info (client.get(), sourceClient, portID, portInfo) != 0
+        || (snd_seq_port_info_get_capability (portInfo)
+            & (forInput ? SND_SEQ_PORT_CAP_SUBS_READ : SND_SEQ_PORT_CAP_SUBS_WRITE)) == 0)
+        return nullptr;
+
+    auto* port = client.createPort (snd_seq_port_info_get_name (portInfo), forInput, false);
+    jassert (port->isValid());
+    port->connectWith (sourceClient, portID);
+    return port;
+}
+
 static AlsaClient::Port* iterateMidiDevices (bool forInput,
                                              Array<MidiDeviceInfo>& devices,
                                              const String& deviceIdentifierToOpen)
@@ -490,6 +600,10 @@ static AlsaClient::Port* iterateMidiDevices (bool forInput,
 
     if (auto seqHandle = client->get())
     {
+        if (deviceIdentifierToOpen.isNotEmpty())
+            if ((port = openMidiPortByIdentifier (*client, forInput, deviceIdentifierToOpen)) != nullptr)
+                return port;
+
         snd_seq_system_info_t* systemInfo = nullptr;
         snd_seq_client_info_t* clientInfo = nullptr;
 
@@ -719,6 +833,16 @@ void MidiOutput::sendMessageNow (const MidiMessage& message)
     internal->ptr->sendMessageNow (message);
 }
 
+void MidiOutput::sendBlockOfMessagesNow (const MidiBuffer& buffer)
+{
+    internal->ptr->sendBlockOfMessagesNow (buffer);
+}
+
+bool MidiOutput::waitForOutputToDrain (int timeoutMilliseconds)
+{
+    return internal->ptr->waitForOutputToDrain (timeoutMilliseconds);
+}
+
 MidiDeviceListConnection MidiDeviceListConnection::make (std::function<void()> cb)
 {
     auto& broadcaster = MidiDeviceListConnectionBroadcaster::get();
@@ -731,6 +855,11 @@ MidiDeviceListConnection MidiDeviceListConnection::make (std::function<void()> c
                                             }) };
 }
 
+int64 MidiDeviceListConnection::getChangeCount()
+{
+    return AlsaClient::getDeviceListChangeCount();
+}
+
 //==============================================================================
 #else
 
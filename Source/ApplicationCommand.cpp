@@ -19,7 +19,10 @@
 #include "ApplicationCommand.h"
 
 #include "ApplicationState.h"
+#include "CommandServer.h"
+#include "MidiClock.h"
 #include "MpeTestScenario.h"
+#include "SysExStreamer.h"
 
 static const String& DEFAULT_VIRTUAL_NAME = "SendMIDI";
 
@@ -28,29 +31,91 @@ inline float sign(float value)
     return (float)(value > 0.) - (value < 0.);
 }
 
-ApplicationCommand ApplicationCommand::Dummy()
+void CommandOptions::add(StringRef option)
 {
-    return {"", "", NONE, 0, {""}, {""}};
+    auto size = (int)option.text.sizeInBytes();
+    if (!onHeap_ && (count_ == INLINE_OPTIONS || used_ + size > INLINE_BYTES))
+    {
+        moveToHeap();
+    }
+    if (onHeap_)
+    {
+        heapStarts_.push_back((int)heapBytes_.size());
+        heapBytes_.insert(heapBytes_.end(), option.text.getAddress(), option.text.getAddress() + size);
+    }
+    else
+    {
+        inlineStarts_[(size_t)count_] = used_;
+        std::memcpy(inlineBytes_.data() + used_, option.text.getAddress(), (size_t)size);
+        used_ += size;
+    }
+    count_ += 1;
+}
+
+void CommandOptions::moveToHeap()
+{
+    heapStarts_.assign(inlineStarts_.begin(), inlineStarts_.begin() + count_);
+    heapBytes_.assign(inlineBytes_.begin(), inlineBytes_.begin() + used_);
+    onHeap_ = true;
+}
+
+void CommandOptions::clear()
+{
+    count_ = 0;
+    used_ = 0;
+    onHeap_ = false;
+    heapStarts_.clear();
+    heapBytes_.clear();
+}
+
+StringRef CommandOptions::operator[](int index) const
+{
+    if (index < 0 || index >= count_)
+    {
+        return {};
+    }
+    auto bytes = onHeap_ ? heapBytes_.data() + heapStarts_[(size_t)index] : inlineBytes_.data() + inlineStarts_[(size_t)index];
+    return String::CharPointerType(bytes);
+}
+
+StringArray CommandOptions::toStringArray() const
+{
+    StringArray result;
+    for (int i = 0; i < count_; ++i)
+    {
+        result.add((*this)[i]);
+    }
+    return result;
 }
 
-void ApplicationCommand::clear()
+void CommandInvocation::start(const ApplicationCommand& descriptor)
+{
+    command_ = descriptor.command_;
+    expectedOptions_ = descriptor.expectedOptions_;
+    opts_.clear();
+    bytes_.clear();
+    if (command_ == SYSTEM_EXCLUSIVE)
+    {
+        bytes_.push_back(0xf0);
+    }
+}
+
+void CommandInvocation::clear()
 {
-    param_ = "";
     command_ = NONE;
     expectedOptions_ = 0;
-    optionsDescriptions_ = StringArray({""});
-    commandDescriptions_ = StringArray({""});
     opts_.clear();
+    bytes_.clear();
 }
 
-void ApplicationCommand::execute(ApplicationState& state)
+void CommandInvocation::execute(ApplicationState& state)
 {
     switch (command_)
     {
         case NONE:
             break;
         case LIST:
-            for (auto&& name : ApplicationState::displayNames(MidiOutput::getAvailableDevices()))
+            for (auto&& name : state.getOutputDevices().getDisplayNames())
             {
                 std::cout << name << std::endl;
             }
@@ -60,6 +125,11 @@ void ApplicationCommand::execute(ApplicationState& state)
             state.openOutputDevice(opts_[0]);
             break;
         }
+        case DEVICES:
+        {
+            state.openOutputDevices(opts_.toStringArray());
+            break;
+        }
         case VIRTUAL:
         {
             auto name = DEFAULT_VIRTUAL_NAME;
@@ -72,23 +142,46 @@ void ApplicationCommand::execute(ApplicationState& state)
         }
         case PANIC:
         {
+            auto full = opts_.size() > 0 && opts_[0].text.compareIgnoreCase(CharPointer_ASCII("full")) == 0;
             for (auto ch = 1; ch <= 16; ++ch)
             {
-                state.sendMidiMessage(MidiMessage::controllerEvent(ch, 64, 0));    // sustain pedal off
-                state.sendMidiMessage(MidiMessage::controllerEvent(ch, 120, 0));   // all sound off
-                state.sendMidiMessage(MidiMessage::controllerEvent(ch, 121, 0));   // reset all controllers
-                state.sendMidiMessage(MidiMessage::controllerEvent(ch, 123, 0));   // all notes off
-                state.sendMidiMessage(MidiMessage::pitchWheel(ch, 0x2000));        // recenter pitch bend
-                for (auto note = 0; note <= 127; ++note)
+                if (full)
+                {
+                    state.sendMidiMessage(MidiMessage::controllerEvent(ch, 64, 0));    // sustain pedal off
+                    state.sendMidiMessage(MidiMessage::controllerEvent(ch, 120, 0));   // all sound off
+                    state.sendMidiMessage(MidiMessage::controllerEvent(ch, 121, 0));   // reset all controllers
+                    state.sendMidiMessage(MidiMessage::controllerEvent(ch, 123, 0));   // all notes off
+                    state.sendMidiMessage(MidiMessage::pitchWheel(ch, 0x2000));        // recenter pitch bend
+                    for (auto note = 0; note <= 127; ++note)
+                    {
+                        state.sendMidiMessage(MidiMessage::noteOff(ch, note, (uint8)0));
+                    }
+                }
+                else
                 {
-                    state.sendMidiMessage(MidiMessage::noteOff(ch, note, (uint8)0));
+                    // the all notes off clears the tracked notes, so they're taken first
+                    auto notesOn = state.getNotesOn(ch);
+                    state.sendMidiMessage(MidiMessage::controllerEvent(ch, 123, 0));   // all notes off
+                    state.sendMidiMessage(MidiMessage::controllerEvent(ch, 120, 0));   // all sound off
+                    state.sendMidiMessage(MidiMessage::controllerEvent(ch, 64, 0));    // sustain pedal off
+                    state.sendMidiMessage(MidiMessage::controllerEvent(ch, 121, 0));   // reset all controllers
+                    state.sendMidiMessage(MidiMessage::pitchWheel(ch, 0x2000));        // recenter pitch bend
+                    // note offs only for the notes that were turned on, in case
+                    // the receiver ignores the channel mode messages
+                    for (auto note = 0; note <= 127; ++note)
+                    {
+                        if (notesOn[(size_t)note])
+                        {
+                            state.sendMidiMessage(MidiMessage::noteOff(ch, note, (uint8)0));
+                        }
+                    }
                 }
             }
             break;
         }
         case TXTFILE:
         {
-            auto path(opts_[0]);
+            String path(opts_[0]);
             auto file = File::getCurrentWorkingDirectory().getChildFile(path);
             if (file.existsAsFile())
             {
@@ -104,6 +197,8 @@ void ApplicationCommand::execute(ApplicationState& state)
         case DECIMAL:
         case HEXADECIMAL:
         case NO_WAIT:
+        case DIN_PORT:
+        case ANCHOR:
             // these are not commands but rather configuration options
             // allow them to be inlined anywhere by handling them immediately in the
             // parseParameters method
@@ -173,12 +268,12 @@ void ApplicationCommand::execute(ApplicationState& state)
         {
             auto arg = opts_[0];
             auto value = 0;
-            if (arg.containsChar('/'))
+            auto slash = arg.text.indexOf((juce_wchar)'/');
+            if (slash >= 0)
             {
-                auto numerator = arg.upToFirstOccurrenceOf("/", false, true);
-                auto denominator = arg.substring(numerator.length()+1);
-                auto numVal = numerator.getFloatValue();
-                auto denomVal = denominator.getFloatValue();
+                // the numerator is read up to the slash
+                auto numVal = (float)arg.text.getDoubleValue();
+                auto denomVal = (float)(arg.text + slash + 1).getDoubleValue();
                 if (fabs(numVal) > denomVal)
                 {
                     numVal = sign(numVal)*denomVal;
@@ -217,16 +312,27 @@ void ApplicationCommand::execute(ApplicationState& state)
                 // are skipped, as they are everywhere else
                 break;
             }
-            auto now = Time::getMillisecondCounter();
             auto bpm = double(jlimit(1, 999, state.asDecOrHexIntValue(opts_[0])));
             // optional beat count, defaulting to the two beats of before,
             // zero keeps the clock running until the process is stopped
             auto beats = opts_.size() > 1 ? jmax(0, state.asDecOrHexIntValue(opts_[1])) : 2;
-            auto msPerTick = (60.0 * 1000.0 / bpm) / 24.0;
-            state.sendMidiMessage(MidiMessage::midiClock());
-            for (auto ticks = 1; beats == 0 || ticks < 24 * beats; ++ticks)
+            auto endBpm = opts_.size() > 2 ? double(jlimit(1, 999, state.asDecOrHexIntValue(opts_[2]))) : bpm;
+            if (beats == 0 && state.isCompiling())
+            {
+                std::cerr << "Can't compile a clock that runs until it's stopped" << std::endl;
+                JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+                break;
+            }
+            if (state.isScheduling())
             {
-                Time::waitForMillisecondCounter(now + uint32(double(ticks) * msPerTick));
+                state.scheduleClock(bpm, endBpm, beats);
+                break;
+            }
+            // when collecting or compiling, the ticks are waited out in line
+            auto now = state.getMicrosecondCounter();
+            for (MidiClock clock(bpm, endBpm, beats); clock.isRunning(); clock.advance())
+            {
+                state.waitForMicrosecondCounter(now + int64(clock.getNextTickOffset()));
                 state.sendMidiMessage(MidiMessage::midiClock());
             }
             break;
@@ -261,16 +367,15 @@ void ApplicationCommand::execute(ApplicationState& state)
             break;
         case SYSTEM_EXCLUSIVE:
         {
-            if (opts_.isEmpty())
+            if (bytes_.size() < 2)
             {
                 break;
             }
-            MemoryBlock mem(opts_.size(), true);
-            for (auto i = 0; i < opts_.size(); ++i)
-            {
-                mem[i] = (uint8)opts_[i].getIntValue();
-            }
-            auto msg = MidiMessage::createSysExMessage(mem.getData(), (int)mem.getSize());
+            // the F7 is only there while the bytes are copied into the
+            // message, so that running the command again doesn't repeat it
+            bytes_.push_back(0xf7);
+            MidiMessage msg(bytes_.data(), (int)bytes_.size());
+            bytes_.pop_back();
             auto msgSize = msg.getRawDataSize();
             state.sendMidiMessage(std::move(msg));
             state.waitForSysExTransmission(msgSize);
@@ -278,42 +383,26 @@ void ApplicationCommand::execute(ApplicationState& state)
         }
         case SYSTEM_EXCLUSIVE_FILE:
         {
-            auto path(opts_[0]);
+            String path(opts_[0]);
             auto file = File::getCurrentWorkingDirectory().getChildFile(path);
-            if (file.existsAsFile())
+            if (!file.existsAsFile())
             {
-                MemoryBlock mem;
-                auto readSuccess = file.loadFileAsData(mem);
-                if (readSuccess && mem.getSize() > 0)
-                {
-                    const uint8* data = (uint8*)mem.getData();
-                    const auto data_size = (int)mem.getSize();
-                    const auto buffer_size = 256;
-                    state.sendMidiMessage(MidiMessage(data, data_size));
-
-                    if (!state.noWait_)
-                    {
-                        std::cout << "Waiting for typical completion on DIN connections 0% (could be done sooner)" << std::flush;
-                        for (auto i = 0; i < data_size; i += buffer_size)
-                        {
-                            auto length = std::min(buffer_size, data_size - i);
-                            std::cout << "\rWaiting for typical completion on DIN connections " << (((i + length) * 100) / data_size) << "% (could be done sooner)" << std::flush;
-                            // don't exceed 31250 baudrate (bits per second)
-                            Thread::sleep((buffer_size * 8 * 1000) / 31250);
-                        }
-                        std::cout << "\rWaiting for typical completion on DIN connections 100%" << std::endl;
-
-                        Thread::sleep(((data_size / buffer_size) + 1) * (8 * 1000) / 31250);
-                    }
-                }
+                std::cerr << "Couldn't find file \"" << path << "\"" << std::endl;
+                JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
             }
-            else
+            else if (!SysExStreamer(state).streamFile(file))
             {
-                std::cerr << "Couldn't find file \"" << path << "\"" << std::endl;
+                std::cerr << "Couldn't read file \"" << path << "\"" << std::endl;
                 JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
             }
             break;
         }
+        case SYSEX_GAP:
+            state.sysExGap_ = jmax(0, state.asDecOrHexIntValue(opts_[0]));
+            break;
+        case SYSEX_RATE:
+            state.sysExRate_ = jmax(0, state.asDecOrHexIntValue(opts_[0]));
+            break;
         case TUNE_REQUEST:
             state.sendMidiMessage(MidiMessage(0xf6));
             break;
@@ -326,7 +415,7 @@ void ApplicationCommand::execute(ApplicationState& state)
         }
         case MPE_PROFILE:
         {
-            auto inputName = opts_[0];
+            auto inputName = String(opts_[0]);
             auto manager = jlimit(1, 15, state.asDecOrHexIntValue(opts_[1]));
             auto members = jlimit(0, 15, state.asDecOrHexIntValue(opts_[2]));
             state.negotiateMpeProfile(inputName, manager, members);
@@ -339,16 +428,49 @@ void ApplicationCommand::execute(ApplicationState& state)
         }
         case RAW_MIDI:
         {
-            if (opts_.isEmpty())
+            if (bytes_.empty())
             {
                 break;
             }
-            MemoryBlock mem(opts_.size(), true);
-            for (auto i = 0; i < opts_.size(); ++i)
+            state.sendMidiMessage(MidiMessage(bytes_.data(), (int)bytes_.size()));
+            break;
+        }
+        case COMPILE:
+        {
+            auto program = File::getCurrentWorkingDirectory().getChildFile(opts_[0]);
+            if (program.existsAsFile())
             {
-                mem[i] = (uint8)state.asDecOrHexIntValue(opts_[i]);
+                state.compileFile(program, File::getCurrentWorkingDirectory().getChildFile(opts_[1]));
             }
-            state.sendMidiMessage(MidiMessage(mem.getData(), (int)mem.getSize()));
+            else
+            {
+                std::cerr << "Couldn't find file \"" << String(opts_[0]) << "\"" << std::endl;
+                JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+            }
+            break;
+        }
+        case PLAY:
+        {
+            auto file = File::getCurrentWorkingDirectory().getChildFile(opts_[0]);
+            if (file.existsAsFile())
+            {
+                state.playFile(file);
+            }
+            else
+            {
+                std::cerr << "Couldn't find file \"" << String(opts_[0]) << "\"" << std::endl;
+                JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+            }
+            break;
+        }
+        case SERVE:
+        {
+            auto path = opts_.isEmpty() ? CommandServer::getSocketPath() : String(opts_[0]);
+            // returns when a client stopped it, with the exit code of the
+            // client's commands left behind, or when it couldn't serve
+            auto stopped = CommandServer::serve(state, path);
+            JUCEApplicationBase::getInstance()->setApplicationReturnValue(stopped ? EXIT_SUCCESS : EXIT_FAILURE);
+            break;
         }
     }
     
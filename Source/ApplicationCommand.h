@@ -26,6 +26,7 @@ enum CommandIndex
     LIST,
     PANIC,
     DEVICE,
+    DEVICES,
     VIRTUAL,
     TXTFILE,
     DECIMAL,
@@ -51,7 +52,11 @@ enum CommandIndex
     RESET,
     SYSTEM_EXCLUSIVE,
     SYSTEM_EXCLUSIVE_FILE,
+    SYSEX_GAP,
+    SYSEX_RATE,
     NO_WAIT,
+    DIN_PORT,
+    ANCHOR,
     TIME_CODE,
     SONG_POSITION,
     SONG_SELECT,
@@ -59,23 +64,70 @@ enum CommandIndex
     MPE_CONFIGURATION,
     MPE_PROFILE,
     MPE_TEST,
-    RAW_MIDI
+    RAW_MIDI,
+    COMPILE,
+    PLAY,
+    SERVE
 };
 
 class ApplicationState;
 
+// What a command is: its names, the number of options it expects (-1 for any
+// number) and its help. The descriptors are set up once by ApplicationState
+// and never change, the commands that are parsed only refer to them.
 struct ApplicationCommand
 {
-    static ApplicationCommand Dummy();
-    
-    void clear();
-    void execute(ApplicationState& state);
-    
     String param_;
     String altParam_;
     CommandIndex command_;
     int expectedOptions_;
     StringArray optionsDescriptions_;
     StringArray commandDescriptions_;
-    StringArray opts_;
+};
+
+// The options of a command that is being parsed, copied into a buffer of its
+// own since a command can span several lines. The options of the channel
+// voice commands fit inline, so they never allocate; longer ones, like the
+// bytes of syx, move to heap storage that keeps its capacity between commands.
+class CommandOptions
+{
+public:
+    void add(StringRef option);
+    void clear();
+    
+    int size() const { return count_; }
+    bool isEmpty() const { return count_ == 0; }
+    // an empty string beyond the last option, like StringArray
+    StringRef operator[](int index) const;
+    StringArray toStringArray() const;
+    
+private:
+    void moveToHeap();
+    
+    static const int INLINE_OPTIONS = 4;
+    static const int INLINE_BYTES = 64;
+    
+    int count_ { 0 };
+    int used_ { 0 };
+    bool onHeap_ { false };
+    std::array<int, INLINE_OPTIONS> inlineStarts_ {};
+    std::array<char, INLINE_BYTES> inlineBytes_ {};
+    std::vector<int> heapStarts_;
+    std::vector<char> heapBytes_;
+};
+
+// A command while it's being parsed and run: which one it is, how many
+// options it still expects and the ones it got so far.
+struct CommandInvocation
+{
+    void start(const ApplicationCommand& descriptor);
+    void clear();
+    void execute(ApplicationState& state);
+    
+    CommandIndex command_ { NONE };
+    int expectedOptions_ { 0 };
+    CommandOptions opts_;
+    // the bytes of syx and raw, read as they're parsed into the framing
+    // they're sent with, a SysEx already starting with its F0
+    std::vector<uint8> bytes_;
 };
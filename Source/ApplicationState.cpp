@@ -17,10 +17,16 @@
  */
 
 #include "ApplicationCommand.h"
+#include "HexDecoder.h"
 #include "ApplicationState.h"
+#include "CommandServer.h"
+#include "LineTokenizer.h"
+#include "StdinReader.h"
 #include "TerminalColor.h"
 
 static const int DEFAULT_OCTAVE_MIDDLE_C = 3;
+// 31250 baud with a start and a stop bit around each byte
+static const int DIN_SYSEX_RATE = 3125;
 
 // Optional ANSI color for the help text. It is emitted only when standard output
 // is an interactive terminal that is expected to understand the codes (see
@@ -104,9 +110,12 @@ static StringArray wrapText(const String& text, int width)
 ApplicationState::ApplicationState()
 {
     commands_.add({"dev",   	"device",                   DEVICE,                 1, {"name"},             {"Set the name of the MIDI output port"}});
+    commands_.add({"devs",  	"devices",                  DEVICES,               -1, {"names"},            {"Send to several MIDI output ports at once, each from a",
+                                                                                        "thread of its own so a slow port doesn't hold up the others"}});
     commands_.add({"virt",  	"virtual",                  VIRTUAL,               -1, {"(name)"},           {"Use virtual MIDI port with optional name (Linux/macOS)"}});
     commands_.add({"list",  	"",                         LIST,                   0, {""},                 {"Lists the MIDI output ports"}});
-    commands_.add({"panic", 	"",                         PANIC,                  0, {""},                 {"Sends Note Offs, panic CCs, resets controllers & bend"}});
+    commands_.add({"panic", 	"",                         PANIC,                  0, {"(full)"},           {"Sends panic CCs, resets controllers & bend, and Note Offs",
+                                                                                        "for the notes that were turned on (full: for all notes)"}});
     commands_.add({"file",  	"",                         TXTFILE,                1, {"path"},             {"Loads commands from the specified program file"}});
     commands_.add({"dec",   	"decimal",                  DECIMAL,                0, {""},                 {"Interpret the next numbers as decimals by default"}});
     commands_.add({"hex",   	"hexadecimal",              HEXADECIMAL,            0, {""},                 {"Interpret the next numbers as hexadecimals by default"}});
@@ -122,17 +131,26 @@ ApplicationState::ApplicationState()
     commands_.add({"pb",    	"pitch-bend",               PITCH_BEND,             1, {"value"},            {"Send Pitch Bend value (0-16383 or value/range)"}});
     commands_.add({"rpn",   	"",                         RPN,                    2, {"number value"},     {"Send RPN number (0-16383) with value (0-16383)"}});
     commands_.add({"nrpn",  	"",                         NRPN,                   2, {"number value"},     {"Send NRPN number (0-16383) with value (0-16383)"}});
-    commands_.add({"clock", 	"",                         CLOCK,                 -1, {"bpm (beats)"},      {"Send MIDI Timing Clock for a BPM (1-999), optionally",
-                                                                                        "for a number of beats (default 2, 0 = until stopped)"}});
+    commands_.add({"clock", 	"",                         CLOCK,                 -1, {"bpm (beats)", "(end)"}, {"Send MIDI Timing Clock for a BPM (1-999), optionally",
+                                                                                        "for a number of beats (default 2, 0 = until stopped),",
+                                                                                        "ramping to an end BPM over them, while the next",
+                                                                                        "commands carry on"}});
     commands_.add({"mc",    	"midi-clock",               MIDI_CLOCK,             0, {""},                 {"Send one MIDI Timing Clock"}});
     commands_.add({"start", 	"",                         START,                  0, {""},                 {"Start the current sequence playing"}});
     commands_.add({"stop",  	"",                         STOP,                   0, {""},                 {"Stop the current sequence"}});
     commands_.add({"cont",  	"continue",                 CONTINUE,               0, {""},                 {"Continue the current sequence"}});
     commands_.add({"as",    	"active-sensing",           ACTIVE_SENSING,         0, {""},                 {"Send Active Sensing"}});
     commands_.add({"rst",   	"reset",                    RESET,                  0, {""},                 {"Send Reset"}});
-    commands_.add({"syx",   	"system-exclusive",         SYSTEM_EXCLUSIVE,      -1, {"bytes"},            {"Send SysEx from a series of bytes (no F0/F7 delimiters)"}});
+    commands_.add({"syx",   	"system-exclusive",         SYSTEM_EXCLUSIVE,      -1, {"bytes"},            {"Send SysEx from a series of bytes (no F0/F7 delimiters)",
+                                                                                        "or from hex blobs like @43104C00"}});
     commands_.add({"syf",   	"system-exclusive-file",    SYSTEM_EXCLUSIVE_FILE,  1, {"path"},             {"Send SysEx from a .syx file"}});
-    commands_.add({"nowait",	"no-wait",                  NO_WAIT,                0, {""},                 {"Don't wait for SysEx to be sent at worst-case MIDI speed"}});
+    commands_.add({"syg",   	"sysex-gap",                SYSEX_GAP,              1, {"ms"},               {"Set the gap between the SysEx messages of syf, defaults to 0"}});
+    commands_.add({"syr",   	"sysex-rate",               SYSEX_RATE,             1, {"bytes"},            {"Set the bytes per second syf sends at most, defaults to",
+                                                                                        "no limit, or 3125 (DIN speed) after din"}});
+    commands_.add({"nowait",	"no-wait",                  NO_WAIT,                0, {""},                 {"Don't wait for SysEx to be sent"}});
+    commands_.add({"din",   	"din-port",                 DIN_PORT,               0, {""},                 {"Wait for SysEx at worst-case MIDI speed, for DIN ports"}});
+    commands_.add({"anchor",	"anchor-timestamps",        ANCHOR,                 0, {""},                 {"Time the next timestamps from when the previous one was",
+                                                                                        "due, starting now, so long sequences don't drift"}});
     commands_.add({"tc",    	"time-code",                TIME_CODE,              2, {"type value"},       {"Send MIDI Time Code with type (0-7) and value (0-15)"}});
     commands_.add({"spp",   	"song-position",            SONG_POSITION,          1, {"beats"},            {"Send Song Position Pointer with beat (0-16383)"}});
     commands_.add({"ss",    	"song-select",              SONG_SELECT,            1, {"number"},           {"Send Song Select with song number (0-127)"}});
@@ -143,17 +161,32 @@ ApplicationState::ApplicationState()
                                                                                         "a manager channel (1-15), and desired member channel",
                                                                                         "count (1-15, 0 to disable) (also uses MIDI output port)"}});
     commands_.add({"mpetest",   "mpe-test",                 MPE_TEST,               0, {""},                 {"Send a sequence of MPE messages to test a receiver"}});
-    commands_.add({"raw",       "raw-midi",                 RAW_MIDI,              -1, {"bytes"},            {"Send raw MIDI from a series of bytes"}});
+    commands_.add({"raw",       "raw-midi",                 RAW_MIDI,              -1, {"bytes"},            {"Send raw MIDI from a series of bytes",
+                                                                                        "or from hex blobs like @903C64"}});
+    commands_.add({"serve",     "",                         SERVE,                 -1, {"(path)"},           {"Keep running with the ports open, for the commands of",
+                                                                                        "\"--client\" calls on a socket (Linux/macOS)"}});
+    commands_.add({"compile",   "",                         COMPILE,                2, {"path output"},      {"Compile a program file into a binary file with its MIDI",
+                                                                                        "and delays, ready to be played back"}});
+    commands_.add({"play",      "",                         PLAY,                   1, {"path"},             {"Play a binary file that was made by compile"}});
     
+    buildCommandTable();
+    resetParseState();
+}
+
+void ApplicationState::resetParseState()
+{
+    currentCommand_.clear();
     channel_ = 1;
     octaveMiddleC_ = DEFAULT_OCTAVE_MIDDLE_C;
     useHexadecimalsByDefault_ = false;
     noWait_ = false;
-    currentCommand_ = ApplicationCommand::Dummy();
+    dinPort_ = false;
+    sysExGap_ = 0;
+    sysExRate_ = 0;
     lastTimeStampCounter_ = 0;
     lastTimeStamp_ = 0;
-    
-    mpeProfile_ = std::make_unique<MpeProfileNegotiation>(this);
+    anchored_ = false;
+    missingOutputPortWarningPrinted_ = false;
 }
 
 void ApplicationState::initialise(JUCEApplicationBase& app)
@@ -172,16 +205,32 @@ void ApplicationState::initialise(JUCEApplicationBase& app)
         return;
     }
     
+    if (cmdLineParams.contains("--client") || cmdLineParams.contains("--stop-server"))
+    {
+        forwardToServer(app, cmdLineParams);
+        return;
+    }
+    
+    printJitter_ = cmdLineParams.contains("--jitter");
+    printClockStats_ = cmdLineParams.contains("--clock-stats");
+    runningStatus_ = cmdLineParams.contains("--running-status");
+    printStatsAsJson_ = cmdLineParams.contains("--stats-json");
+    if (printStatsAsJson_ || cmdLineParams.contains("--stats"))
+    {
+        stats_ = std::make_unique<SendStats>();
+    }
+    
     parseParameters(cmdLineParams);
     
     if (cmdLineParams.contains("--"))
     {
-        while (std::cin)
+        // standard input is read ahead on a thread of its own, the line
+        // buffer is reused and tokenized in place
+        StdinReader input;
+        std::string line;
+        while (input.nextLine(line))
         {
-            std::string line;
-            getline(std::cin, line);
-            StringArray params = parseLineAsParameters(line);
-            parseParameters(params);
+            runLine(line.data());
         }
     }
     
@@ -190,7 +239,30 @@ void ApplicationState::initialise(JUCEApplicationBase& app)
         printUsage();
     }
     
-    while (mpeProfile_->isWaitingForNegotation())
+    finishScheduledMessages();
+    if (printJitter_ && scheduler_ != nullptr)
+    {
+        scheduler_->printJitter();
+    }
+    if (printJitter_ && runningStatus_)
+    {
+        auto saved = runningStatusBytesSaved_ + (midiOut_ != nullptr ? midiOut_->getRunningStatusBytesSaved() : 0);
+        std::cout << "Running status left out " << saved << " status bytes" << std::endl;
+    }
+    if (printClockStats_ && scheduler_ != nullptr)
+    {
+        scheduler_->getClockStats().print();
+    }
+    if (stats_ != nullptr && printStatsAsJson_)
+    {
+        std::cout << JSON::toString(stats_->toVar(), true) << std::endl;
+    }
+    else if (stats_ != nullptr)
+    {
+        stats_->print();
+    }
+    
+    while (mpeProfile_ != nullptr && mpeProfile_->isWaitingForNegotation())
     {
         if (!MessageManager::getInstance()->runDispatchLoopUntil(100))
         {
@@ -203,10 +275,62 @@ void ApplicationState::initialise(JUCEApplicationBase& app)
     app.systemRequestedQuit();
 }
 
-ApplicationCommand* ApplicationState::findApplicationCommand(const String& param)
+// FNV-1a over the lower-cased characters, so that a name hashes the same
+// whichever case it's typed in
+uint32 ApplicationState::hashCommandName(StringRef name)
 {
-    for (auto&& cmd : commands_)
+    uint32 hash = 2166136261u;
+    for (auto p = name.text; ! p.isEmpty();)
     {
+        hash = (hash ^ (uint32)CharacterFunctions::toLowerCase(p.getAndAdvance())) * 16777619u;
+    }
+    return hash;
+}
+
+void ApplicationState::buildCommandTable()
+{
+    // keep the table at most a quarter full, so lookups rarely probe past
+    // their first slot
+    size_t size = 16;
+    while (size < (size_t)commands_.size() * 2 * 4)
+    {
+        size *= 2;
+    }
+    commandTable_.assign(size, -1);
+
+    auto insert = [this](const String& name, int index)
+    {
+        if (name.isEmpty())
+        {
+            return;
+        }
+        const auto mask = commandTable_.size() - 1;
+        for (auto slot = hashCommandName(name) & mask; ; slot = (slot + 1) & mask)
+        {
+            if (commandTable_[slot] < 0)
+            {
+                commandTable_[slot] = index;
+                return;
+            }
+        }
+    };
+    for (int i = 0; i < commands_.size(); ++i)
+    {
+        insert(commands_.getReference(i).param_, i);
+        insert(commands_.getReference(i).altParam_, i);
+    }
+}
+
+const ApplicationCommand* ApplicationState::findApplicationCommand(StringRef param) const
+{
+    if (param.isEmpty())
+    {
+        return nullptr;
+    }
+    const auto mask = commandTable_.size() - 1;
+    for (auto slot = hashCommandName(param) & mask; commandTable_[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        auto& cmd = commands_.getReference(commandTable_[slot]);
         if (cmd.param_.equalsIgnoreCase(param) || cmd.altParam_.equalsIgnoreCase(param))
         {
             return &cmd;
@@ -218,136 +342,201 @@ ApplicationCommand* ApplicationState::findApplicationCommand(const String& param
 StringArray ApplicationState::parseLineAsParameters(const String& line)
 {
     StringArray parameters;
-    if (!line.startsWith("#"))
+    std::string buffer(line.toRawUTF8());
+    LineTokenizer tokens(buffer.data());
+    while (auto token = tokens.next())
     {
-        StringArray tokens;
-        tokens.addTokens(line, true);
-        tokens.removeEmptyStrings(true);
-        for (String token : tokens)
-        {
-            parameters.add(token.trimCharactersAtStart("\"").trimCharactersAtEnd("\""));
-        }
+        parameters.add(String::fromUTF8(token));
     }
     return parameters;
 }
 
-bool ApplicationState::isNumeric(const String& string)
+void ApplicationState::runLine(char* line)
 {
-    return string.containsOnly("1234567890");
+    parseLine(line);
+    handleVarArgCommand();
 }
 
-int64_t ApplicationState::parseTimestamp(const String& param)
+void ApplicationState::parseLine(char* line)
 {
-    int64_t timestamp = 0;
-    if (param.length() == 12 && param[2] == ':' && param[5] == ':' && param[8] == '.')
+    LineTokenizer tokens(line);
+    auto token = tokens.next();
+    while (token != nullptr)
     {
-        auto hours = param.substring(0, 2);
-        auto minutes = param.substring(3, 5);
-        auto seconds = param.substring(6, 8);
-        auto millis = param.substring(9);
-        if (isNumeric(hours) && isNumeric(minutes) && isNumeric(seconds) && isNumeric(millis))
+        auto next = tokens.next();
+        if (parseParameter(StringRef(token), next != nullptr ? StringRef(next) : StringRef()))
         {
-            auto now = Time();
-            timestamp = Time(now.getYear(), now.getMonth(), now.getDayOfMonth(),
-                             hours.getIntValue(), minutes.getIntValue(), seconds.getIntValue(), millis.getIntValue()).toMilliseconds();
+            next = tokens.next();
         }
+        token = next;
     }
-    else if (param.length() == 13 && param[0] == '+' && param[3] == ':' && param[6] == ':' && param[9] == '.')
+}
+
+int64_t ApplicationState::parseTimestamp(StringRef param)
+{
+    auto text = param.text.getAddress();
+    return ValueParser::timestamp(text, text + std::strlen(text));
+}
+
+StringArray ApplicationState::displayNames(const Array<MidiDeviceInfo>& devices)
+{
+    return DeviceRegistry::displayNames(devices);
+}
+
+int ApplicationState::matchDeviceIndex(const Array<MidiDeviceInfo>& devices, const String& name)
+{
+    DeviceRegistry registry(DeviceRegistry::OUTPUTS);
+    registry.setDevices(devices);
+    return registry.find(name);
+}
+
+// a compiled program is played on whichever port is selected when playing it,
+// so the commands that pick ports are left out of it
+static bool skipPortWhileCompiling(const ApplicationState& state)
+{
+    if (!state.isCompiling())
     {
-        auto hours = param.substring(1, 3);
-        auto minutes = param.substring(4, 6);
-        auto seconds = param.substring(7, 9);
-        auto millis = param.substring(10);
-        if (isNumeric(hours) && isNumeric(minutes) && isNumeric(seconds) && isNumeric(millis))
-        {
-            timestamp = (((int64_t(hours.getIntValue()) * 60 + int64_t(minutes.getIntValue())) * 60) + int64_t(seconds.getIntValue())) * 1000 + millis.getIntValue();
-        }
+        return false;
     }
-    else if (param.length() == 7 && param[0] == '+' && param[3] == '.')
+    static bool warningPrinted = false;
+    if (!warningPrinted)
     {
-        auto seconds = param.substring(1, 3);
-        auto millis = param.substring(4);
-        if (isNumeric(seconds) && isNumeric(millis))
-        {
-            timestamp = (int64_t(seconds.getIntValue())) * 1000 + millis.getIntValue();
-        }
+        std::cerr << "Port commands aren't compiled, select the port when playing the program instead" << std::endl;
+        warningPrinted = true;
     }
-    return timestamp;
+    return true;
 }
 
-StringArray ApplicationState::displayNames(const Array<MidiDeviceInfo>& devices)
+// sends the command line, and the lines of standard input after "--", to a
+// server instead of running them here
+void ApplicationState::forwardToServer(JUCEApplicationBase& app, const StringArray& cmdLineParams)
 {
-    StringArray names;
-    for (int i = 0; i < devices.size(); ++i)
+    StringArray parameters(cmdLineParams);
+    parameters.removeString("--client");
+    parameters.removeString("--stop-server");
+    parameters.removeString("--");
+    StringArray lines;
+    if (!parameters.isEmpty())
     {
-        int total = 0;
-        int position = 1;
-        for (int j = 0; j < devices.size(); ++j)
-        {
-            if (devices[j].name == devices[i].name)
-            {
-                total += 1;
-                if (j < i)
-                {
-                    position += 1;
-                }
-            }
-        }
-        if (total > 1)
-        {
-            names.add(devices[i].name + " (" + String(position) + ")");
-        }
-        else
+        lines.add(CommandServer::joinParameters(parameters));
+    }
+    if (cmdLineParams.contains("--"))
+    {
+        StdinReader input;
+        std::string line;
+        while (input.nextLine(line))
         {
-            names.add(devices[i].name);
+            lines.add(String::fromUTF8(line.data(), (int)line.size()));
         }
     }
-    return names;
+    if (cmdLineParams.contains("--stop-server"))
+    {
+        lines.add(CommandServer::STOP_REQUEST);
+    }
+    
+    // relative paths are the client's, and what the commands print is shown here
+    auto path = CommandServer::getSocketPath();
+    auto result = CommandServer::forward(path, lines, File::getCurrentWorkingDirectory(), std::cout, std::cerr);
+    if (result < 0)
+    {
+        std::cerr << "Couldn't reach a server on \"" << path << "\"" << std::endl;
+        result = EXIT_FAILURE;
+    }
+    app.setApplicationReturnValue(result);
+    app.systemRequestedQuit();
 }
 
-int ApplicationState::matchDeviceIndex(const Array<MidiDeviceInfo>& devices, const String& name)
+void ApplicationState::openOutputDevice(const String& name)
 {
-    StringArray names = displayNames(devices);
-    for (int i = 0; i < devices.size(); ++i)
+    if (skipPortWhileCompiling(*this))
     {
-        if (names[i] == name)
-        {
-            return i;
-        }
+        return;
     }
-    for (int i = 0; i < devices.size(); ++i)
+    
+    closeOutputDevice();
+    setOutputPort(openOutputPort(name));
+}
+
+void ApplicationState::openOutputDevices(const StringArray& names)
+{
+    if (skipPortWhileCompiling(*this))
     {
-        if (devices[i].name == name)
-        {
-            return i;
-        }
+        return;
     }
-    for (int i = 0; i < devices.size(); ++i)
+    
+    closeOutputDevice();
+    std::vector<std::unique_ptr<MidiPort>> ports;
+    for (auto&& name : names)
     {
-        if (devices[i].name.containsIgnoreCase(name))
+        if (auto port = openOutputPort(name))
         {
-            return i;
+            ports.push_back(std::move(port));
         }
     }
-    return -1;
+    if (ports.size() == 1)
+    {
+        setOutputPort(std::move(ports.front()));
+    }
+    else if (!ports.empty())
+    {
+        setOutputPort(std::make_unique<FanOutPort>(std::move(ports)));
+    }
 }
 
-void ApplicationState::openOutputDevice(const String& name)
+std::unique_ptr<MidiPort> ApplicationState::openOutputPort(const String& name)
 {
-    midiOut_ = nullptr;
     midiOutName_ = name;
-    auto devices = MidiOutput::getAvailableDevices();
-    auto index = matchDeviceIndex(devices, name);
-    if (index >= 0)
+    if (name.startsWith(MidiPort::RAWMIDI_PREFIX))
     {
-        midiOut_ = MidiOutput::openDevice(devices[index].identifier);
-        midiOutName_ = devices[index].name;
+        return openRawMidiDevice(name.substring((int)strlen(MidiPort::RAWMIDI_PREFIX)));
     }
-    if (midiOut_ == nullptr)
+    
+    std::unique_ptr<MidiPort> port;
+    if (auto device = outputDevices_.findDevice(name))
+    {
+        port = MidiPort::wrap(MidiOutput::openDevice(device->identifier));
+        midiOutName_ = device->name;
+    }
+    if (port == nullptr)
     {
         std::cerr << "Couldn't find MIDI output port \"" << midiOutName_ << "\"" << std::endl;
         JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
     }
+    return port;
+}
+
+void ApplicationState::closeOutputDevice()
+{
+    flushScheduledMessages();
+    if (midiOut_ != nullptr)
+    {
+        runningStatusBytesSaved_ += midiOut_->getRunningStatusBytesSaved();
+        setOutputPort(nullptr);
+    }
+}
+
+void ApplicationState::setOutputPort(std::unique_ptr<MidiPort> port)
+{
+    const ScopedLock lock(outputLock_);
+    midiOut_ = std::move(port);
+}
+
+std::unique_ptr<MidiPort> ApplicationState::openRawMidiDevice(const String& device)
+{
+    if (!MidiPort::isRawMidiSupported())
+    {
+        std::cerr << "Raw MIDI ports are only supported on Linux with ALSA" << std::endl;
+        JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+        return nullptr;
+    }
+    
+    auto port = MidiPort::openRawMidi(device, runningStatus_);
+    if (port == nullptr)
+    {
+        std::cerr << "Couldn't open raw MIDI device \"" << device << "\"" << std::endl;
+        JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+    }
+    return port;
 }
 
 void ApplicationState::openInputDevice(const String& name)
@@ -365,12 +554,10 @@ bool ApplicationState::tryToConnectMidiInput(const String& name)
     std::unique_ptr<MidiInput> midi_input = nullptr;
     String midi_input_name = name;
 
-    auto devices = MidiInput::getAvailableDevices();
-    auto index = matchDeviceIndex(devices, name);
-    if (index >= 0)
+    if (auto device = inputDevices_.findDevice(name))
     {
-        midi_input = MidiInput::openDevice(devices[index].identifier, this);
-        midi_input_name = devices[index].name;
+        midi_input = MidiInput::openDevice(device->identifier, this);
+        midi_input_name = device->name;
     }
 
     if (midi_input)
@@ -386,33 +573,28 @@ bool ApplicationState::tryToConnectMidiInput(const String& name)
 
 bool ApplicationState::isMidiInDeviceAvailable(const String& name)
 {
-    auto devices = MidiInput::getAvailableDevices();
-    for (int i = 0; i < devices.size(); ++i)
-    {
-        if (devices[i].name == name)
-        {
-            return true;
-        }
-    }
-    return false;
+    return inputDevices_.findByName(name) >= 0;
 }
 
 void ApplicationState::handleIncomingMidiMessage(MidiInput*, const MidiMessage& msg)
 {
-    if (msg.isSysEx())
+    if (msg.isSysEx() && mpeProfile_ != nullptr)
     {
-        // we don't have any other application threads going on, so this is safe
-        // even though ci::Device is not thread safe, in a proper application
-        // this should done asynchronously on the message thread
+        // ci::Device isn't thread safe, but the main thread only waits while
+        // the negotiation runs here; the replies share the port with the
+        // scheduler thread, which processMessage takes care of
         mpeProfile_->processMessage({0, msg.getSysExDataSpan()});
     }
 }
 
 void ApplicationState::processMessage(ump::BytesOnGroup umsg)
 {
-    // only process CI messages if both MIDI input and output is connected
+    // only process CI messages if both MIDI input and output is connected,
+    // sent under the output lock since this runs on the MIDI input thread
+    // while the scheduler thread may be sending to the same port
     if (midiIn_.get())
     {
+        const ScopedLock lock(outputLock_);
         if (auto out = midiOut_.get())
         {
             auto msg = MidiMessage::createSysExMessage(umsg.bytes);
@@ -423,8 +605,14 @@ void ApplicationState::processMessage(ump::BytesOnGroup umsg)
 
 void ApplicationState::virtualDevice(const String& name)
 {
+    if (skipPortWhileCompiling(*this))
+    {
+        return;
+    }
+    
 #if (JUCE_LINUX || JUCE_MAC)
-    midiOut_ = MidiOutput::createNewDevice(name);
+    closeOutputDevice();
+    setOutputPort(MidiPort::wrap(MidiOutput::createNewDevice(name)));
     if (midiOut_ == nullptr)
     {
         std::cerr << "Couldn't create virtual MIDI output port \"" << name << "\"" << std::endl;
@@ -442,8 +630,10 @@ void ApplicationState::virtualDevice(const String& name)
 
 void ApplicationState::executeCurrentCommand()
 {
-    auto cmd = currentCommand_;
-    currentCommand_ = ApplicationCommand::Dummy();
+    // the command can parse more commands while it runs, like a program file
+    // does, so it's moved out of the way first
+    auto cmd = std::move(currentCommand_);
+    currentCommand_.clear();
     cmd.execute(*this);
 }
 
@@ -457,109 +647,308 @@ void ApplicationState::handleVarArgCommand()
 
 void ApplicationState::parseParameters(StringArray& parameters)
 {
-    for (auto param : parameters)
+    for (int i = 0; i < parameters.size(); ++i)
     {
-        if (param == "--") continue;
-        
-        auto cmd = findApplicationCommand(param);
-        if (cmd)
+        if (parseParameter(parameters[i], i + 1 < parameters.size() ? StringRef(parameters[i + 1]) : StringRef()))
         {
-            // handle configuration commands immediately without setting up a new one
-            switch (cmd->command_)
-            {
-                case DECIMAL:
-                    useHexadecimalsByDefault_ = false;
-                    break;
-                case HEXADECIMAL:
-                    useHexadecimalsByDefault_ = true;
-                    break;
-                case NO_WAIT:
-                    noWait_ = true;
-                    break;
-                default:
-                    handleVarArgCommand();
-                    
-                    currentCommand_ = *cmd;
-                    break;
-            }
+            ++i;
         }
-        else
+    }
+    
+    handleVarArgCommand();
+}
+
+bool ApplicationState::parseParameter(StringRef param, StringRef next)
+{
+    if (param == StringRef("--") || param == StringRef("--jitter") || param == StringRef("--clock-stats") ||
+        param == StringRef("--running-status") || param == StringRef("--stats") || param == StringRef("--stats-json")) return false;
+    
+    auto tookNext = false;
+    
+    auto cmd = findApplicationCommand(param);
+    if (cmd)
+    {
+        // handle configuration commands immediately without setting up a new one
+        switch (cmd->command_)
         {
-            auto timestamp = parseTimestamp(param);
-            if (timestamp)
-            {
+            case DECIMAL:
+                useHexadecimalsByDefault_ = false;
+                break;
+            case HEXADECIMAL:
+                useHexadecimalsByDefault_ = true;
+                break;
+            case NO_WAIT:
+                noWait_ = true;
+                break;
+            case DIN_PORT:
+                dinPort_ = true;
+                break;
+            case ANCHOR:
+                anchored_ = true;
+                lastTimeStampCounter_ = getMicrosecondCounter();
+                break;
+            default:
                 handleVarArgCommand();
                 
-                if (param[0] == '+')
+                currentCommand_.start(*cmd);
+                
+                // panic runs right away, with the word full when it follows
+                if (cmd->command_ == PANIC && next.text.compareIgnoreCase(CharPointer_ASCII("full")) == 0)
                 {
-                    Time::waitForMillisecondCounter(uint32(Time::getMillisecondCounter() + timestamp));
+                    currentCommand_.opts_.add(next);
+                    tookNext = true;
                 }
-                else if (lastTimeStamp_ != 0)
+                break;
+        }
+    }
+    else
+    {
+        auto timestamp = parseTimestamp(param);
+        if (timestamp)
+        {
+            handleVarArgCommand();
+            
+            // when anchored, each timestamp is due at the time the previous one
+            // was due plus the difference between them, instead of at the time
+            // the previous wait actually ended, so that late wake-ups and the
+            // time spent in between don't add up over a long sequence
+            if (param[0] == '+')
+            {
+                auto target = (anchored_ ? lastTimeStampCounter_ : getMicrosecondCounter()) + timestamp;
+                waitForMicrosecondCounter(target);
+                lastTimeStampCounter_ = anchored_ ? target : getMicrosecondCounter();
+            }
+            else if (lastTimeStamp_ != 0)
+            {
+                auto span = timestamp - lastTimeStamp_;
+                
+                // compensate for day boundary wrap around
+                if (timestamp < lastTimeStamp_)
                 {
-                    // wait for the time that needs to have elapsed since the previous timestamp
-                    auto now_counter = Time::getMillisecondCounter();
-                    auto delta = (timestamp - lastTimeStamp_) - (now_counter - lastTimeStampCounter_);
-                    
-                    // compensate for day boundary wrap around
-                    if (timestamp < lastTimeStamp_)
-                    {
-                        delta += 24 * 60 * 60 * 1000;
-                    }
-                    
-                    // wait for the required time
-                    if (delta > 0)
-                    {
-                        Time::waitForMillisecondCounter(uint32(now_counter + delta));
-                    }
+                    span += int64_t(24) * 60 * 60 * 1000000;
                 }
                 
-                lastTimeStampCounter_ = Time::getMillisecondCounter();
-                lastTimeStamp_ = timestamp;
+                // wait for the time that needs to have elapsed since the previous timestamp
+                auto target = lastTimeStampCounter_ + span;
+                waitForMicrosecondCounter(target);
+                lastTimeStampCounter_ = anchored_ ? target : getMicrosecondCounter();
             }
-            else if (currentCommand_.command_ == NONE)
+            else
             {
-                auto file = File::getCurrentWorkingDirectory().getChildFile(param);
-                if (file.existsAsFile())
-                {
-                    parseFile(file);
-                }
+                lastTimeStampCounter_ = getMicrosecondCounter();
             }
-            else if (currentCommand_.expectedOptions_ != 0)
+            
+            lastTimeStamp_ = timestamp;
+        }
+        else if (currentCommand_.command_ == NONE)
+        {
+            auto file = File::getCurrentWorkingDirectory().getChildFile(param);
+            if (file.existsAsFile())
             {
-                if (currentCommand_.command_ == SYSTEM_EXCLUSIVE)
-                {
-                    currentCommand_.opts_.add(String(asDecOrHex7BitValue(param)));
-                }
-                else
-                {
-                    currentCommand_.opts_.add(param);
-                }
-                currentCommand_.expectedOptions_ -= 1;
+                parseFile(file);
             }
         }
+        else if (currentCommand_.expectedOptions_ != 0)
+        {
+            // the bytes of syx and raw go straight into the message they
+            // make up, instead of being kept as text
+            if ((currentCommand_.command_ == SYSTEM_EXCLUSIVE || currentCommand_.command_ == RAW_MIDI) &&
+                param[0] == '@')
+            {
+                addHexBlob(param);
+            }
+            else if (currentCommand_.command_ == SYSTEM_EXCLUSIVE)
+            {
+                currentCommand_.bytes_.push_back(asDecOrHex7BitValue(param));
+            }
+            else if (currentCommand_.command_ == RAW_MIDI)
+            {
+                currentCommand_.bytes_.push_back((uint8)asDecOrHexIntValue(param));
+            }
+            else
+            {
+                currentCommand_.opts_.add(param);
+            }
+            currentCommand_.expectedOptions_ -= 1;
+        }
+    }
+    
+    // handle fixed arg commands
+    if (currentCommand_.expectedOptions_ == 0)
+    {
+        executeCurrentCommand();
+    }
+    
+    return tookNext;
+}
+
+// a hex blob like @43104C00 is decoded into the command's bytes in one go;
+// a SysEx blob may start with F0 and end with F7, which are already there
+void ApplicationState::addHexBlob(StringRef param)
+{
+    auto sysEx = currentCommand_.command_ == SYSTEM_EXCLUSIVE;
+    auto hex = param.text.getAddress() + 1;
+    auto length = std::strlen(hex);
+    if (sysEx && length >= 2 && (hex[0] | 0x20) == 'f' && hex[1] == '0')
+    {
+        hex += 2;
+        length -= 2;
+    }
+    if (sysEx && length >= 2 && (hex[length - 2] | 0x20) == 'f' && hex[length - 1] == '7')
+    {
+        length -= 2;
+    }
+    
+    auto& bytes = currentCommand_.bytes_;
+    auto start = bytes.size();
+    bytes.resize(start + length / 2);
+    auto decoded = HexDecoder::decode(hex, length, bytes.data() + start, sysEx);
+    if (decoded == length)
+    {
+        return;
+    }
+    
+    bytes.resize(start);
+    if (decoded + 1 == length)
+    {
+        std::cerr << "Skipped a hex blob with an odd number of digits" << std::endl;
+    }
+    else
+    {
+        auto pair = String(hex + decoded, 2);
+        auto position = (int)(hex - param.text.getAddress() + (int)decoded);
+        auto isByte = CharacterFunctions::getHexDigitValue(pair[0]) >= 0 && CharacterFunctions::getHexDigitValue(pair[1]) >= 0;
+        std::cerr << "Skipped a hex blob with \"" << pair << "\" at character " << position
+                  << (isByte ? ", SysEx bytes have to be below 80" : ", which isn't a hex byte") << std::endl;
+    }
+    JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+}
+
+void ApplicationState::parseFile(File file)
+{
+    FileInputStream in(file);
+    if (in.failedToOpen())
+    {
+        return;
+    }
+    
+    // UTF-16 program files are rare enough to still be read in one go, all
+    // the others stream through a fixed size chunk
+    uint8 bom[3] = {};
+    auto bomSize = in.read(bom, 3);
+    if (bomSize >= 2 && ((bom[0] == 0xff && bom[1] == 0xfe) || (bom[0] == 0xfe && bom[1] == 0xff)))
+    {
+        StringArray lines;
+        file.readLines(lines);
+        std::string buffer;
+        for (auto&& line : lines)
+        {
+            buffer.assign(line.toRawUTF8());
+            parseLine(buffer.data());
+        }
+        handleVarArgCommand();
+        return;
+    }
+    if (!(bomSize == 3 && bom[0] == 0xef && bom[1] == 0xbb && bom[2] == 0xbf))
+    {
+        in.setPosition(0);
+    }
+    
+    // each line is executed as soon as it's complete, so neither the memory
+    // used nor the time before the first message goes out grows with the size
+    // of the file; commands that span lines, like syx, carry on into the next
+    // line since the parser state is only settled at the very end
+    const int chunkSize = 64 * 1024;
+    HeapBlock<char> chunk(chunkSize);
+    std::string line;
+    auto afterCarriageReturn = false;
+    for (;;)
+    {
+        auto read = in.read(chunk, chunkSize);
+        if (read <= 0)
+        {
+            break;
+        }
         
-        // handle fixed arg commands
-        if (currentCommand_.expectedOptions_ == 0)
+        auto start = chunk.get();
+        auto end = chunk + read;
+        for (auto p = start; p < end; ++p)
         {
-            executeCurrentCommand();
+            if (*p != '\n' && *p != '\r')
+            {
+                continue;
+            }
+            
+            // like StringArray::addLines, CR LF ends a single line
+            auto crlf = afterCarriageReturn && *p == '\n' && p == start;
+            afterCarriageReturn = *p == '\r';
+            if (!crlf)
+            {
+                line.append(start, p);
+                parseLine(line.data());
+                line.clear();
+            }
+            start = p + 1;
         }
+        line.append(start, end);
+        if (start != end)
+        {
+            afterCarriageReturn = false;
+        }
+    }
+    if (!line.empty())
+    {
+        parseLine(line.data());
     }
     
     handleVarArgCommand();
 }
 
-void ApplicationState::parseFile(File file)
+void ApplicationState::compileFile(File program, File output)
 {
-    StringArray parameters;
+    if (isCompiling())
+    {
+        std::cerr << "Can't compile \"" << program.getFileName() << "\" while already compiling" << std::endl;
+        JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+        return;
+    }
     
-    StringArray lines;
-    file.readLines(lines);
-    for (auto line : lines)
+    CompiledProgram::Writer writer(output);
+    if (!writer.openedOk())
     {
-        parameters.addArray(parseLineAsParameters(line));
+        std::cerr << "Couldn't write compiled program \"" << output.getFullPathName() << "\"" << std::endl;
+        JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+        return;
     }
     
-    parseParameters(parameters);
+    // the timestamps of the program are measured on its own playing time
+    auto lastTimeStamp = lastTimeStamp_;
+    auto lastTimeStampCounter = lastTimeStampCounter_;
+    lastTimeStamp_ = 0;
+    lastTimeStampCounter_ = 0;
+    compileTime_ = 0;
+    compiler_ = &writer;
+    
+    parseFile(program);
+    
+    compiler_ = nullptr;
+    lastTimeStamp_ = lastTimeStamp;
+    lastTimeStampCounter_ = lastTimeStampCounter;
+    
+    if (!writer.finish())
+    {
+        std::cerr << "Couldn't write compiled program \"" << output.getFullPathName() << "\"" << std::endl;
+        JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+    }
+}
+
+void ApplicationState::playFile(File file)
+{
+    if (!CompiledProgram::play(*this, file))
+    {
+        std::cerr << "\"" << file.getFileName() << "\" isn't a complete compiled program" << std::endl;
+        JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+    }
 }
 
 Array<MidiMessage> ApplicationState::collect(const StringArray& parameters)
@@ -577,132 +966,353 @@ Array<MidiMessage> ApplicationState::collectLine(const String& line)
     return collect(parseLineAsParameters(line));
 }
 
+void ApplicationState::collectLine(char* line, Array<MidiMessage>& sink)
+{
+    messageSink_ = &sink;
+    runLine(line);
+    messageSink_ = nullptr;
+}
+
 void ApplicationState::sendMidiMessage(MidiMessage&& msg)
 {
+    // the scheduler times the sends to a port, only collecting and compiling
+    // are timed here
+    if (stats_ == nullptr || (compiler_ == nullptr && messageSink_ == nullptr))
+    {
+        dispatchMidiMessage(std::move(msg));
+        return;
+    }
+    // the message is moved on, so what's counted is taken first
+    auto kind = SendStats::kindOf(msg);
+    auto size = msg.getRawDataSize();
+    auto start = Time::getHighResolutionTicks();
+    dispatchMidiMessage(std::move(msg));
+    stats_->addMessage(kind, size, Time::getHighResolutionTicks() - start);
+}
+
+// the message is moved into the sink or the scheduler's queue, so a long
+// SysEx isn't copied on its way out
+void ApplicationState::dispatchMidiMessage(MidiMessage&& msg)
+{
+    trackNotes(msg);
+    if (compiler_ != nullptr)
+    {
+        compiler_->addMessage(msg);
+        return;
+    }
     if (messageSink_ != nullptr)
     {
-        messageSink_->add(msg);
+        messageSink_->add(std::move(msg));
+        return;
+    }
+    if (midiOut_ != nullptr)
+    {
+        getScheduler().schedule(std::move(msg), Time::secondsToHighResolutionTicks((double)catchUpScheduleCursor() / 1000000.0));
+    }
+    else
+    {
+        warnAboutMissingOutputPort();
+    }
+}
+
+void ApplicationState::trackNotes(const MidiMessage& msg)
+{
+    auto channel = msg.getChannel();
+    if (channel == 0)
+    {
         return;
     }
-    if (auto out = midiOut_.get())
+    auto& notes = notesOn_[(size_t)channel - 1];
+    if (msg.isNoteOn())
+    {
+        notes.set((size_t)msg.getNoteNumber());
+    }
+    else if (msg.isNoteOff())
+    {
+        notes.reset((size_t)msg.getNoteNumber());
+    }
+    else if (msg.isAllNotesOff() || msg.isAllSoundOff())
+    {
+        notes.reset();
+    }
+}
+
+void ApplicationState::scheduleClock(double startBpm, double endBpm, int beats)
+{
+    if (midiOut_ != nullptr)
     {
-        out->sendMessageNow(msg);
+        getScheduler().scheduleClock(startBpm, endBpm, beats, Time::secondsToHighResolutionTicks((double)catchUpScheduleCursor() / 1000000.0));
     }
     else
     {
-        static bool missingOutputPortWarningPrinted = false;
-        if (!missingOutputPortWarningPrinted)
+        warnAboutMissingOutputPort();
+    }
+}
+
+MidiScheduler& ApplicationState::getScheduler()
+{
+    if (scheduler_ == nullptr)
+    {
+        scheduler_ = std::make_unique<MidiScheduler>([this](const MidiBuffer& messages)
+        {
+            const ScopedLock lock(outputLock_);
+            if (auto out = midiOut_.get())
+            {
+                out->sendBlockOfMessagesNow(messages);
+            }
+        }, stats_.get(), [this](const MidiMessage& msg)
+        {
+            const ScopedLock lock(outputLock_);
+            if (auto out = midiOut_.get())
+            {
+                out->sendMessageNow(msg);
+            }
+        });
+        if (stats_ != nullptr)
         {
-            std::cerr << "No valid MIDI output port was specified for some of the messages" << std::endl;
-            JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
-            missingOutputPortWarningPrinted = true;
+            stats_->setTiming(SendStats::PORT_SENDS);
         }
     }
+    return *scheduler_;
+}
+
+void ApplicationState::warnAboutMissingOutputPort()
+{
+    if (!missingOutputPortWarningPrinted_)
+    {
+        std::cerr << "No valid MIDI output port was specified for some of the messages" << std::endl;
+        JUCEApplicationBase::getInstance()->setApplicationReturnValue(EXIT_FAILURE);
+        missingOutputPortWarningPrinted_ = true;
+    }
+}
+
+int ApplicationState::getSysExRate() const
+{
+    // only a DIN port is known to be slower than the port lets on
+    if (sysExRate_ > 0 || !dinPort_)
+    {
+        return sysExRate_;
+    }
+    return DIN_SYSEX_RATE;
 }
 
 void ApplicationState::waitForSysExTransmission(int byteCount)
 {
-    if (messageSink_ != nullptr || noWait_)
+    if ((messageSink_ != nullptr && !isCompiling()) || noWait_)
     {
         return;
     }
     // the process exits right after the commands are done, and closing the
-    // port too early can cut off a SysEx that is still on its way out, so
-    // wait for the time the bytes take at worst-case MIDI speed
-    Thread::sleep(jmax(1, (byteCount * 8 * 1000) / 31250));
+    // port too early can cut off a SysEx that is still on its way out
+    auto worstCase = jmax(1, (byteCount * 8 * 1000) / 31250);
+    const ScopedValueSetter<bool> sysExWait(waitingForSysEx_, true);
+    if (isScheduling() && midiOut_ != nullptr)
+    {
+        auto start = Time::getHighResolutionTicks();
+        flushScheduledMessages();
+        // the port knows when it's done, except for how long a DIN connection
+        // behind the system still takes
+        // the wait doesn't take the output lock, so that a running clock keeps
+        // ticking while the SysEx drains
+        auto drained = midiOut_->waitUntilDrained(worstCase) && (!dinPort_ || midiOut_->drainsToWire());
+        if (stats_ != nullptr)
+        {
+            stats_->addSysExWait(Time::getHighResolutionTicks() - start);
+        }
+        if (drained)
+        {
+            return;
+        }
+    }
+    // otherwise wait for the time the bytes take at worst-case MIDI speed
+    sleep(worstCase);
 }
 
-void ApplicationState::sendRPN(int channel, int number, int value)
+// how far the parser may run ahead of the messages that are being sent, so
+// that console output and incoming MIDI stay in step with them
+static const int64 SCHEDULE_LOOK_AHEAD_MICROS = 20000;
+
+static int64 microsecondsNow()
 {
-    number = limit14Bit(number);
-    value = limit14Bit(value);
-    sendMidiMessage(MidiMessage::controllerEvent(channel, 101, number >> 7));
-    sendMidiMessage(MidiMessage::controllerEvent(channel, 100, number & 0x7f));
-    sendMidiMessage(MidiMessage::controllerEvent(channel, 6, value >> 7));
-    sendMidiMessage(MidiMessage::controllerEvent(channel, 38, value & 0x7f));
-    sendMidiMessage(MidiMessage::controllerEvent(channel, 101, 0x7f));
-    sendMidiMessage(MidiMessage::controllerEvent(channel, 100, 0x7f));
+    return (int64)(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks()) * 1000000.0);
 }
 
-void ApplicationState::negotiateMpeProfile(const String& name, int manager, int members)
+// sleeps for most of the time and yields for the last millisecond, since a
+// sleep can easily overshoot
+static void waitForMicroseconds(int64 target)
 {
-    openInputDevice(name);
-    if (midiIn_)
+    for (auto remaining = target - microsecondsNow(); remaining > 0; remaining = target - microsecondsNow())
     {
-        mpeProfile_->negotiate(manager, members);
+        if (remaining > 2000)
+        {
+            Thread::sleep((int)(remaining / 1000) - 1);
+        }
+        else
+        {
+            Thread::yield();
+        }
+    }
+}
+
+// the schedule can't lie in the past, otherwise the parser would fall behind
+// while it's waiting for input and then send the next messages too early
+int64 ApplicationState::catchUpScheduleCursor()
+{
+    scheduleCursor_ = jmax(scheduleCursor_, microsecondsNow());
+    return scheduleCursor_;
+}
+
+int64 ApplicationState::getMicrosecondCounter()
+{
+    if (isCompiling())
+    {
+        return compileTime_;
+    }
+    if (isScheduling())
+    {
+        return catchUpScheduleCursor();
     }
+    return microsecondsNow();
 }
 
-uint8 ApplicationState::asNoteNumber(String value)
+void ApplicationState::waitForMicrosecondCounter(int64 target)
 {
-    if (value.length() >= 2)
+    if (stats_ != nullptr)
     {
-        value = value.toUpperCase();
-        auto first = value.substring(0, 1);
-        if (first.containsOnly("CDEFGABH") &&
-            value.substring(value.length()-1).containsOnly("1234567890"))
+        auto start = Time::getHighResolutionTicks();
+        waitForMicrosecondCounterUntimed(target);
+        auto waited = Time::getHighResolutionTicks() - start;
+        if (waitingForSysEx_)
         {
-            auto note = 0;
-            switch (first[0])
-            {
-                case 'C': note = 0; break;
-                case 'D': note = 2; break;
-                case 'E': note = 4; break;
-                case 'F': note = 5; break;
-                case 'G': note = 7; break;
-                case 'A': note = 9; break;
-                case 'B': note = 11; break;
-                case 'H': note = 11; break;
-            }
-            
-            if (value[1] == 'B')
-            {
-                note -= 1;
-            }
-            else if (value[1] == '#')
+            stats_->addSysExWait(waited);
+        }
+        else
+        {
+            stats_->addTimestampWait(waited);
+        }
+        return;
+    }
+    waitForMicrosecondCounterUntimed(target);
+}
+
+void ApplicationState::waitForMicrosecondCounterUntimed(int64 target)
+{
+    if (isScheduling())
+    {
+        if (target > catchUpScheduleCursor())
+        {
+            scheduleCursor_ = target;
+            auto ahead = scheduleCursor_ - microsecondsNow();
+            if (ahead > SCHEDULE_LOOK_AHEAD_MICROS)
             {
-                note += 1;
+                Thread::sleep((int)((ahead - SCHEDULE_LOOK_AHEAD_MICROS) / 1000));
             }
-            
-            note += (value.getTrailingIntValue() + 5 - octaveMiddleC_) * 12;
-            
-            return (uint8)limit7Bit(note);
         }
+        return;
+    }
+    if (isCompiling())
+    {
+        if (target > compileTime_)
+        {
+            compiler_->addDelay(target - compileTime_);
+            compileTime_ = target;
+        }
+        return;
     }
-    
-    return (uint8)limit7Bit(asDecOrHexIntValue(value));
+    waitForMicroseconds(target);
 }
 
-uint8 ApplicationState::asDecOrHex7BitValue(String value)
+void ApplicationState::sleep(int milliseconds)
 {
-    return (uint8)limit7Bit(asDecOrHexIntValue(value));
+    if (isCompiling() || isScheduling())
+    {
+        waitForMicrosecondCounter(getMicrosecondCounter() + int64(jmax(0, milliseconds)) * 1000);
+        return;
+    }
+    Thread::sleep(milliseconds);
 }
 
-uint16 ApplicationState::asDecOrHex14BitValue(String value)
+void ApplicationState::finishScheduledMessages()
 {
-    return (uint16)limit14Bit(asDecOrHexIntValue(value));
+    if (scheduler_ != nullptr)
+    {
+        scheduler_->finish();
+    }
+    flushScheduledMessages();
 }
 
-int ApplicationState::asDecOrHexIntValue(String value)
+void ApplicationState::flushScheduledMessages()
 {
-    if (value.endsWithIgnoreCase("H"))
+    if (scheduler_ != nullptr)
+    {
+        scheduler_->flush();
+    }
+    if (isScheduling())
     {
-        return value.dropLastCharacters(1).getHexValue32();
+        waitForMicroseconds(scheduleCursor_);
     }
-    else if (value.endsWithIgnoreCase("M"))
+}
+
+void ApplicationState::sendRPN(int channel, int number, int value)
+{
+    number = limit14Bit(number);
+    value = limit14Bit(value);
+    sendMidiMessage(MidiMessage::controllerEvent(channel, 101, number >> 7));
+    sendMidiMessage(MidiMessage::controllerEvent(channel, 100, number & 0x7f));
+    sendMidiMessage(MidiMessage::controllerEvent(channel, 6, value >> 7));
+    sendMidiMessage(MidiMessage::controllerEvent(channel, 38, value & 0x7f));
+    sendMidiMessage(MidiMessage::controllerEvent(channel, 101, 0x7f));
+    sendMidiMessage(MidiMessage::controllerEvent(channel, 100, 0x7f));
+}
+
+void ApplicationState::negotiateMpeProfile(const String& name, int manager, int members)
+{
+    if (skipPortWhileCompiling(*this))
     {
-        return value.getIntValue();
+        return;
     }
-    else if (useHexadecimalsByDefault_)
+    
+    flushScheduledMessages();
+    // the MIDI-CI device is only set up when it's needed, and before the
+    // input can deliver its replies
+    if (mpeProfile_ == nullptr)
     {
-        return value.getHexValue32();
+        mpeProfile_ = std::make_unique<MpeProfileNegotiation>(this);
     }
-    else
+    openInputDevice(name);
+    if (midiIn_)
     {
-        return value.getIntValue();
+        mpeProfile_->negotiate(manager, members);
     }
 }
 
+ValueParser ApplicationState::valueParser() const
+{
+    return ValueParser(octaveMiddleC_, useHexadecimalsByDefault_);
+}
+
+uint8 ApplicationState::asNoteNumber(StringRef value)
+{
+    auto text = value.text.getAddress();
+    return valueParser().noteNumber(text, text + std::strlen(text));
+}
+
+uint8 ApplicationState::asDecOrHex7BitValue(StringRef value)
+{
+    return limit7Bit(asDecOrHexIntValue(value));
+}
+
+uint16 ApplicationState::asDecOrHex14BitValue(StringRef value)
+{
+    return limit14Bit(asDecOrHexIntValue(value));
+}
+
+int ApplicationState::asDecOrHexIntValue(StringRef value)
+{
+    auto text = value.text.getAddress();
+    return valueParser().intValue(text, text + std::strlen(text));
+}
+
 uint8 ApplicationState::limit7Bit(int value)
 {
     return (uint8)jlimit(0, 0x7f, value);
@@ -824,6 +1434,13 @@ void ApplicationState::printUsage()
     std::cout << ansi::paint(ansi::label, "Options:") << std::endl;
     builtin("-h  or  --help", "Print Help (this message) and exit");
     builtin("--version", "Print version information and exit");
+    builtin("--jitter", "Print how late the messages were sent compared to their timing, when done");
+    builtin("--clock-stats", "Print how regular the clock ticks were, when done");
+    builtin("--running-status", "Leave out repeated status bytes on rawmidi ports");
+    builtin("--stats", "Print the messages and bytes per second, the time to send each kind of message and the time spent waiting, when done");
+    builtin("--stats-json", "Print the same as --stats in JSON");
+    builtin("--client", "Send the commands to a running \"serve\" instead of running them");
+    builtin("--stop-server", "Stop a running \"serve\", after the commands of --client");
     builtin("--", "Read commands from standard input until it's closed");
     std::cout << std::endl;
     std::cout << "Alternatively, you can use the following long versions of the commands:" << std::endl;
@@ -894,6 +1511,11 @@ void ApplicationState::printUsage()
     << "Ports that share the same name are listed with a number, like \"Port (2)\"," << std::endl
     << "and that numbered name can be used to select that specific port." << std::endl;
     std::cout << std::endl;
+    std::cout << "On Linux, a hardware port can also be opened directly as an ALSA rawmidi" << std::endl
+    << note("device, bypassing the sequencer, with \"dev rawmidi:hw:1,0,0\". The") << std::endl
+    << note("\"--running-status\" option then leaves out the status byte of channel messages") << std::endl
+    << note("that repeat it, and \"--jitter\" also prints how many bytes that saved.") << std::endl;
+    std::cout << std::endl;
     std::cout << "Where notes can be provided as arguments, they can also be written as note" << std::endl
     << "names, by default from C-2 to G8 which corresponds to note numbers 0 to 127." << std::endl
     << "By setting the octave for middle C, the note name range can be changed. " << std::endl
@@ -911,4 +1533,9 @@ void ApplicationState::printUsage()
     << "+00:00:01.060 will execute the next command one second and 60 milliseconds"  << std::endl
     << "later. For convenience, a relative timestamp can also be shortened to +SS.MIL"  << std::endl
     << "(for example: +01.060)." << std::endl;
+    std::cout << std::endl;
+    std::cout << "The milliseconds of any timestamp can be written as microseconds instead," << std::endl
+    << "with six digits (for example: +01.060250). After the anchor command, each" << std::endl
+    << "timestamp is timed from when the previous one was due, instead of from when" << std::endl
+    << "its wait ended, so that long sequences don't drift." << std::endl;
 }
@@ -18,10 +18,19 @@
 
 #pragma once
 
+#include <bitset>
+
 #include "JuceHeader.h"
 
 #include "ApplicationCommand.h"
+#include "CompiledProgram.h"
+#include "DeviceRegistry.h"
+#include "FanOutPort.h"
+#include "MidiPort.h"
+#include "MidiScheduler.h"
 #include "MpeProfileNegotiation.h"
+#include "SendStats.h"
+#include "ValueParser.h"
 
 class ApplicationState : public MidiInputCallback, public ci::DeviceMessageHandler
 {
@@ -30,76 +39,173 @@ public:
     void initialise(JUCEApplicationBase& app);
         
     void openOutputDevice(const String& name);
+    void openOutputDevices(const StringArray& names);
     void waitForSysExTransmission(int byteCount);
+    // the bytes per second syf sends at most, 0 for no limit
+    int getSysExRate() const;
     void openInputDevice(const String& name);
     void virtualDevice(const String& name);
     void parseFile(File file);
+    // runs a line of commands like one read from standard input, the line is
+    // tokenized in place
+    void runLine(char* line);
+    // drops a command that's still waiting for its options and puts the
+    // settings back to how they start, while the ports stay open, so that
+    // the clients of a server don't inherit them from each other
+    void resetParseState();
+    void compileFile(File program, File output);
+    void playFile(File file);
+    bool isCompiling() const { return compiler_ != nullptr; }
+    bool isScheduling() const { return messageSink_ == nullptr && !isCompiling(); }
     void sendMidiMessage(MidiMessage&& msg);
+    // the notes that were turned on and not off yet, on a channel (1-16)
+    const std::bitset<128>& getNotesOn(int channel) const { return notesOn_[(size_t)channel - 1]; }
     void sendRPN(int channel, int number, int value);
     void negotiateMpeProfile(const String& name, int manager, int members);
     
-    uint8 asNoteNumber(String value);
-    uint8 asDecOrHex7BitValue(String value);
-    uint16 asDecOrHex14BitValue(String value);
-    int asDecOrHexIntValue(String value);
+    // the clock that commands wait on: when sending to a port, it's the
+    // deadline the scheduled messages have reached and waiting moves that
+    // deadline on; while compiling, it's the playing time the compiled program
+    // has reached and waiting adds a delay to the program instead
+    int64 getMicrosecondCounter();
+    
+    // when the last timestamp was due with anchor, or when its wait ended
+    // without it, in the microseconds of getMicrosecondCounter
+    int64 getLastTimeStampCounter() const { return lastTimeStampCounter_; }
+    void waitForMicrosecondCounter(int64 target);
+    void sleep(int milliseconds);
+    
+    // blocks until the scheduled messages are sent and the time the commands
+    // waited for has passed, before the port changes or a SysEx is waited
+    // out; a running clock carries on
+    void flushScheduledMessages();
+    
+    // the same, and blocks until the clock ended too, before the process exits
+    void finishScheduledMessages();
+    
+    // starts a clock that runs on the scheduler thread from the current
+    // deadline on, while the commands that follow carry on
+    void scheduleClock(double startBpm, double endBpm, int beats);
+    
+    // the values of command options, read in place with ValueParser
+    uint8 asNoteNumber(StringRef value);
+    uint8 asDecOrHex7BitValue(StringRef value);
+    uint16 asDecOrHex14BitValue(StringRef value);
+    int asDecOrHexIntValue(StringRef value);
+    
+    // the microseconds of a timestamp token: for a time of day, since the
+    // epoch at that local time on the date of Time(), which is only used for
+    // the differences between timestamps; for a relative one starting with
+    // '+', the offset; 0 when the token isn't a timestamp
+    static int64_t parseTimestamp(StringRef param);
+    
+    // a parser with the current octave of middle C and default number base
+    ValueParser valueParser() const;
     
     static uint8 limit7Bit(int value);
     static uint16 limit14Bit(int value);
 
-    // the names to show for these MIDI devices: ports that share the same
-    // name get a number appended, like "sooperlooper (2)", so each of them
-    // can be told apart and selected
+    // the names to show for these MIDI devices and the device a name refers
+    // to, with the rules of DeviceRegistry; returns -1 when nothing matches
     static StringArray displayNames(const Array<MidiDeviceInfo>& devices);
-
-    // finds the device a name refers to: first as one of the display names
-    // above, then as an exact port name, then as a piece of a port name,
-    // ignoring case; returns -1 when nothing matches
     static int matchDeviceIndex(const Array<MidiDeviceInfo>& devices, const String& name);
+
+    // the MIDI output ports, listed once and kept until they change
+    DeviceRegistry& getOutputDevices() { return outputDevices_; }
+
+    // finds the command for a name or its long version, ignoring case,
+    // through the lookup table that's built once in the constructor
+    const ApplicationCommand* findApplicationCommand(StringRef param) const;
+    const Array<ApplicationCommand>& getCommands() const { return commands_; }
     
     void printVersion();
     void printUsage();
 
     // Test seam: parse a command line and return the MIDI messages it produces,
     // collected in memory instead of sent to a device, so command output can be
-    // asserted without opening a MIDI port. Don't use device, virtual, file,
+    // asserted without opening a MIDI port. Don't use device, virtual,
     // mpe-profile or timestamp tokens here - those open ports or wait.
     Array<MidiMessage> collect(const StringArray& parameters);
     Array<MidiMessage> collectLine(const String& line);
+    // the same for a line that's tokenized in place, into a sink that's kept
+    // between calls, so that the seam itself doesn't allocate for every line
+    void collectLine(char* line, Array<MidiMessage>& sink);
 
     int channel_;
     int octaveMiddleC_;
     bool noWait_;
+    bool dinPort_;
+    int sysExGap_;      // in milliseconds
+    int sysExRate_;     // in bytes per second, 0 for no limit
+    bool waitingForSysEx_ { false };    // the waits count as SysEx waits in the statistics
     
 private:
-    ApplicationCommand* findApplicationCommand(const String& param);
+    static uint32 hashCommandName(StringRef name);
+    void buildCommandTable();
     StringArray parseLineAsParameters(const String& line);
+    void parseLine(char* line);
     
+    void forwardToServer(JUCEApplicationBase& app, const StringArray& cmdLineParams);
+    void closeOutputDevice();
+    void setOutputPort(std::unique_ptr<MidiPort> port);
+    std::unique_ptr<MidiPort> openOutputPort(const String& name);
+    std::unique_ptr<MidiPort> openRawMidiDevice(const String& device);
     bool tryToConnectMidiInput(const String& name);
     bool isMidiInDeviceAvailable(const String& name);
     void handleIncomingMidiMessage(MidiInput*, const MidiMessage& msg) override;
     void processMessage(ump::BytesOnGroup) override;
 
-    bool isNumeric(const String& string);
-    int64_t parseTimestamp(const String& param);
-
     void executeCurrentCommand();
     void handleVarArgCommand();
     void parseParameters(StringArray& parameters);
+    // the parameter after it is only there to be looked at, returns true when
+    // it was taken as well
+    bool parseParameter(StringRef param, StringRef next = StringRef());
+    void addHexBlob(StringRef param);
+    
+    int64 catchUpScheduleCursor();
+    MidiScheduler& getScheduler();
+    void warnAboutMissingOutputPort();
+    void trackNotes(const MidiMessage& msg);
+    void dispatchMidiMessage(MidiMessage&& msg);
+    void waitForMicrosecondCounterUntimed(int64 target);
 
     Array<ApplicationCommand> commands_;
-    ApplicationCommand currentCommand_;
+    std::vector<int> commandTable_;     // open addressing: slot -> index in commands_, -1 when empty
+    CommandInvocation currentCommand_;
 
     String midiOutName_;
-    std::unique_ptr<MidiOutput> midiOut_;
+    // the port is sent to from the scheduler thread and, with MIDI-CI replies,
+    // from the MIDI input thread, so sending, draining and changing the port
+    // all hold this lock
+    CriticalSection outputLock_;
+    std::unique_ptr<MidiPort> midiOut_;
     Array<MidiMessage>* messageSink_ { nullptr };   // when set, sendMidiMessage collects here instead of sending
+    CompiledProgram::Writer* compiler_ { nullptr }; // when set, messages and waits are compiled instead
+    int64 compileTime_ { 0 };
+    // declared after the port, so that it stops before the port is closed
+    std::unique_ptr<MidiScheduler> scheduler_;
+    int64 scheduleCursor_ { 0 };        // in microseconds
+    bool printJitter_ { false };
+    bool printClockStats_ { false };
+    bool runningStatus_ { false };
+    std::unique_ptr<SendStats> stats_;  // only kept with --stats or --stats-json
+    bool printStatsAsJson_ { false };
+    std::array<std::bitset<128>, 16> notesOn_;
+    int64 runningStatusBytesSaved_ { 0 };   // by the ports that were closed
     
     std::unique_ptr<MidiInput> midiIn_;
     
+    DeviceRegistry outputDevices_ { DeviceRegistry::OUTPUTS };
+    DeviceRegistry inputDevices_ { DeviceRegistry::INPUTS };
+    
     std::unique_ptr<MpeProfileNegotiation> mpeProfile_;
     
     String fullMidiInName_;
     bool useHexadecimalsByDefault_;
-    uint32 lastTimeStampCounter_;
+    int64_t lastTimeStampCounter_;      // in microseconds, like the timestamps
     int64_t lastTimeStamp_;
+    bool anchored_;
+    bool missingOutputPortWarningPrinted_ { false };
 };
 
@@ -0,0 +1,379 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CommandServer.h"
+
+#include "ApplicationState.h"
+
+#if JUCE_LINUX || JUCE_MAC
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+const char* const CommandServer::CWD_REQUEST = "#@cwd ";
+const char* const CommandServer::STOP_REQUEST = "#@stop";
+
+bool CommandServer::isSupported()
+{
+#if JUCE_LINUX || JUCE_MAC
+    return true;
+#else
+    return false;
+#endif
+}
+
+String CommandServer::getSocketPath()
+{
+    auto path = SystemStats::getEnvironmentVariable("SENDMIDI_SOCKET", {});
+    if (path.isNotEmpty())
+    {
+        return path;
+    }
+    auto runtime = SystemStats::getEnvironmentVariable("XDG_RUNTIME_DIR", {});
+    if (runtime.isNotEmpty())
+    {
+        return runtime + "/sendmidi.sock";
+    }
+#if JUCE_LINUX || JUCE_MAC
+    return "/tmp/sendmidi-" + String((int)getuid()) + ".sock";
+#else
+    return {};
+#endif
+}
+
+String CommandServer::joinParameters(const StringArray& parameters)
+{
+    String line;
+    for (auto&& param : parameters)
+    {
+        if (line.isNotEmpty())
+        {
+            line << " ";
+        }
+        // the tokenizer keeps quoted whitespace together
+        if (param.isEmpty() || param.containsAnyOf(" \t\r\n"))
+        {
+            line << param.quoted();
+        }
+        else
+        {
+            line << param;
+        }
+    }
+    return line;
+}
+
+#if JUCE_LINUX || JUCE_MAC
+
+static bool makeAddress(const String& path, sockaddr_un& address)
+{
+    zerostruct(address);
+    address.sun_family = AF_UNIX;
+    auto utf8 = path.toRawUTF8();
+    if (path.isEmpty() || strlen(utf8) >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    strcpy(address.sun_path, utf8);
+    return true;
+}
+
+static int connectTo(const String& path)
+{
+    sockaddr_un address;
+    if (!makeAddress(path, address))
+    {
+        return -1;
+    }
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const char* data, size_t size)
+{
+    // a client that went away mustn't end the server with SIGPIPE
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (size > 0)
+    {
+        auto sent = send(fd, data, size, flags);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+// reads up to the next line break, keeping what follows it for the next call
+static bool receiveLine(int fd, std::string& pending, std::string& line)
+{
+    for (;;)
+    {
+        auto end = pending.find('\n');
+        if (end != std::string::npos)
+        {
+            line.assign(pending, 0, end);
+            pending.erase(0, end + 1);
+            return true;
+        }
+        char buffer[4096];
+        auto received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        pending.append(buffer, (size_t)received);
+    }
+}
+
+// runs a line with what it prints kept, and returns the reply to it
+static String runRequest(ApplicationState& state, std::string& line)
+{
+    auto app = JUCEApplicationBase::getInstance();
+    if (app != nullptr)
+    {
+        app->setApplicationReturnValue(EXIT_SUCCESS);
+    }
+
+    std::stringbuf out, err;
+    auto* previousOut = std::cout.rdbuf(&out);
+    auto* previousErr = std::cerr.rdbuf(&err);
+    state.runLine(line.data());
+    std::cout.rdbuf(previousOut);
+    std::cerr.rdbuf(previousErr);
+
+    String reply;
+    auto addLines = [&reply](const std::string& text, const char* prefix)
+    {
+        StringArray lines;
+        lines.addLines(String::fromUTF8(text.data(), (int)text.size()));
+        if (text.empty() || text.back() == '\n')
+        {
+            lines.remove(lines.size() - 1);
+        }
+        for (auto&& printed : lines)
+        {
+            reply << prefix << printed << "\n";
+        }
+    };
+    addLines(out.str(), ">");
+    addLines(err.str(), "!");
+    reply << (app != nullptr ? app->getApplicationReturnValue() : EXIT_SUCCESS) << "\n";
+    return reply;
+}
+
+bool CommandServer::serve(ApplicationState& state, const String& path)
+{
+    static bool serving = false;
+    if (serving)
+    {
+        std::cerr << "Already serving commands" << std::endl;
+        return false;
+    }
+
+    // a socket that's left behind by a server that's gone is replaced,
+    // but not one that another server is still listening on
+    auto existing = connectTo(path);
+    if (existing >= 0)
+    {
+        close(existing);
+        std::cerr << "Another server is already listening on \"" << path << "\"" << std::endl;
+        return false;
+    }
+    // anything else at the path, like a mistyped file name, is left alone
+    struct stat existingStat;
+    if (lstat(path.toRawUTF8(), &existingStat) == 0)
+    {
+        if (!S_ISSOCK(existingStat.st_mode))
+        {
+            std::cerr << "\"" << path << "\" exists and isn't a socket" << std::endl;
+            return false;
+        }
+        unlink(path.toRawUTF8());
+    }
+
+    // only the user that runs the server may connect to it, since any
+    // client can drive its ports
+    sockaddr_un address;
+    auto listener = makeAddress(path, address) ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+    auto bound = false;
+    if (listener >= 0)
+    {
+        auto previousMask = umask(0077);
+        bound = bind(listener, (sockaddr*)&address, sizeof(address)) == 0;
+        umask(previousMask);
+    }
+    if (!bound || chmod(path.toRawUTF8(), S_IRUSR | S_IWUSR) != 0 || listen(listener, 16) != 0)
+    {
+        if (listener >= 0)
+        {
+            close(listener);
+        }
+        std::cerr << "Couldn't listen on \"" << path << "\"" << std::endl;
+        return false;
+    }
+    serving = true;
+
+    // each client's lines run in its own directory, and then the server's again
+    auto home = File::getCurrentWorkingDirectory();
+    auto stopping = false;
+    auto failed = false;
+    std::string pending, line;
+    while (!stopping)
+    {
+        auto client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // running out of descriptors or memory can pass once a client
+            // is done, anything else won't
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                Thread::sleep(100);
+                continue;
+            }
+            std::cerr << "Couldn't accept clients on \"" << path << "\"" << std::endl;
+            failed = true;
+            break;
+        }
+#ifdef SO_NOSIGPIPE
+        auto noSigPipe = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+        // the clients take turns, so that their commands don't interleave,
+        // and each one starts from the same settings with the same ports
+        state.resetParseState();
+        pending.clear();
+        while (receiveLine(client, pending, line))
+        {
+            String reply;
+            if (line.rfind(CWD_REQUEST, 0) == 0)
+            {
+                auto directory = File(String::fromUTF8(line.data() + strlen(CWD_REQUEST)));
+                auto changed = directory.isDirectory() && directory.setAsCurrentWorkingDirectory();
+                reply = changed ? "0\n" : "!Couldn't change to directory \"" + directory.getFullPathName() + "\"\n1\n";
+            }
+            else if (line == STOP_REQUEST)
+            {
+                stopping = true;
+                reply = "0\n";
+            }
+            else
+            {
+                reply = runRequest(state, line);
+            }
+            if (!sendAll(client, reply.toRawUTF8(), (size_t)reply.getNumBytesAsUTF8()))
+            {
+                break;
+            }
+        }
+        close(client);
+        home.setAsCurrentWorkingDirectory();
+
+        // what a client left unfinished isn't finished by the next one
+        state.resetParseState();
+    }
+
+    close(listener);
+    unlink(path.toRawUTF8());
+    serving = false;
+    return !failed;
+}
+
+int CommandServer::forward(const String& path, const StringArray& lines, const File& directory,
+                           std::ostream& out, std::ostream& err)
+{
+    auto fd = connectTo(path);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    StringArray requests(CWD_REQUEST + directory.getFullPathName());
+    requests.addArray(lines);
+
+    auto result = 0;
+    std::string pending, reply;
+    for (auto&& line : requests)
+    {
+        auto request = line.removeCharacters("\r\n") + "\n";
+        if (!sendAll(fd, request.toRawUTF8(), (size_t)request.getNumBytesAsUTF8()))
+        {
+            result = -1;
+            break;
+        }
+        // what the line printed comes first, then its exit code
+        auto answered = false;
+        while (!answered && receiveLine(fd, pending, reply))
+        {
+            if (!reply.empty() && reply[0] == '>')
+            {
+                out << reply.substr(1) << std::endl;
+            }
+            else if (!reply.empty() && reply[0] == '!')
+            {
+                err << reply.substr(1) << std::endl;
+            }
+            else
+            {
+                result = jmax(result, String(reply).getIntValue());
+                answered = true;
+            }
+        }
+        if (!answered)
+        {
+            result = -1;
+            break;
+        }
+    }
+    close(fd);
+    return result;
+}
+
+#else
+
+bool CommandServer::serve(ApplicationState&, const String&)
+{
+    std::cerr << "Serving commands is only supported on Linux and macOS" << std::endl;
+    return false;
+}
+
+int CommandServer::forward(const String&, const StringArray&, const File&, std::ostream&, std::ostream&)
+{
+    return -1;
+}
+
+#endif
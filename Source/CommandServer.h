@@ -0,0 +1,62 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+class ApplicationState;
+
+// Keeps a SendMIDI process running with its ports open, and runs the lines
+// of commands that clients send to it over a Unix domain socket, so that a
+// script doesn't pay for starting up and opening a port on every call.
+//
+// The protocol is line based: each line is run like a line read from
+// standard input, and answered with what it printed, each line of standard
+// output after a '>' and of standard error after a '!', followed by a line
+// holding the exit code it would have had in a process of its own. Each
+// client starts with the settings of a new process, on the server's ports,
+// and the socket only lets the server's user connect. Two lines
+// are requests to the server instead: "#@cwd <directory>" runs the lines that
+// follow in that directory, so that relative paths are the client's, and
+// "#@stop" stops the server once the client is done. To other servers they're
+// comments.
+class CommandServer
+{
+public:
+    static const char* const CWD_REQUEST;
+    static const char* const STOP_REQUEST;
+
+    static bool isSupported();
+
+    // $SENDMIDI_SOCKET, or a socket in the runtime directory of the user
+    static String getSocketPath();
+
+    // runs until a client asks it to stop, returns false when it can't listen
+    // or can no longer accept clients
+    static bool serve(ApplicationState& state, const String& path);
+
+    // sends the lines to a server, to run in the directory, and writes what
+    // they printed to out and err; returns the highest exit code the server
+    // answered with, or -1 when it can't be reached
+    static int forward(const String& path, const StringArray& lines, const File& directory,
+                       std::ostream& out, std::ostream& err);
+
+    // joins command line parameters into a line that splits into them again
+    static String joinParameters(const StringArray& parameters);
+};
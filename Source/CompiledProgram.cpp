@@ -0,0 +1,219 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CompiledProgram.h"
+
+#include "ApplicationState.h"
+
+static const char MAGIC[] = { 'S', 'M', 'C', 'P' };
+
+CompiledProgram::Writer::Writer(const File& file)
+: file_(file)
+{
+    out_ = file_.getFile().createOutputStream();
+    if (out_ != nullptr)
+    {
+        out_->write(MAGIC, sizeof(MAGIC));
+        out_->writeByte((char)VERSION);
+    }
+}
+
+bool CompiledProgram::Writer::openedOk() const
+{
+    return out_ != nullptr && out_->openedOk();
+}
+
+void CompiledProgram::Writer::writeNumber(uint64 value)
+{
+    do
+    {
+        auto byte = (uint8)(value & 0x7f);
+        value >>= 7;
+        out_->writeByte((char)(value != 0 ? (byte | 0x80) : byte));
+    }
+    while (value != 0);
+}
+
+void CompiledProgram::Writer::flushDelay()
+{
+    if (pendingDelay_ > 0)
+    {
+        writeNumber(0);
+        writeNumber((uint64)pendingDelay_);
+        pendingDelay_ = 0;
+    }
+}
+
+void CompiledProgram::Writer::addMessage(const MidiMessage& msg)
+{
+    if (msg.getRawDataSize() <= 0)
+    {
+        return;
+    }
+    flushDelay();
+    writeNumber((uint64)msg.getRawDataSize());
+    out_->write(msg.getRawData(), (size_t)msg.getRawDataSize());
+}
+
+void CompiledProgram::Writer::addDelay(int64 microseconds)
+{
+    // consecutive delays become a single record
+    pendingDelay_ += jmax((int64)0, microseconds);
+}
+
+bool CompiledProgram::Writer::finish()
+{
+    if (!openedOk())
+    {
+        return false;
+    }
+    flushDelay();
+    out_->flush();
+    auto ok = !out_->getStatus().failed();
+    out_ = nullptr;
+    return ok && file_.overwriteTargetFileWithTemporary();
+}
+
+// reads an unsigned LEB128 number, or returns false when the data ends first
+static bool readNumber(const uint8*& p, const uint8* end, uint64& value)
+{
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        auto byte = *p++;
+        value |= (uint64)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+CompiledProgram::Reader::Reader(const File& file)
+: mapped_(file, MemoryMappedFile::readOnly)
+{
+    auto data = (const uint8*)mapped_.getData();
+    auto size = mapped_.getSize();
+    if (data != nullptr && size >= sizeof(MAGIC) + 1 &&
+        memcmp(data, MAGIC, sizeof(MAGIC)) == 0 && data[sizeof(MAGIC)] == VERSION)
+    {
+        pos_ = data + sizeof(MAGIC) + 1;
+        end_ = data + size;
+    }
+}
+
+bool CompiledProgram::Reader::openedOk() const
+{
+    return pos_ != nullptr;
+}
+
+bool CompiledProgram::Reader::failed() const
+{
+    return failed_;
+}
+
+bool CompiledProgram::Reader::next(const uint8*& message, int& size, int64& delay)
+{
+    if (pos_ == end_ || failed_)
+    {
+        return false;
+    }
+    
+    uint64 number;
+    if (!readNumber(pos_, end_, number))
+    {
+        failed_ = true;
+        return false;
+    }
+    if (number == 0)
+    {
+        uint64 microseconds;
+        if (!readNumber(pos_, end_, microseconds))
+        {
+            failed_ = true;
+            return false;
+        }
+        message = nullptr;
+        size = 0;
+        delay = (int64)microseconds;
+    }
+    else
+    {
+        if (number > (uint64)(end_ - pos_) || number > (uint64)std::numeric_limits<int>::max())
+        {
+            failed_ = true;
+            return false;
+        }
+        message = pos_;
+        size = (int)number;
+        delay = 0;
+        pos_ += number;
+    }
+    return true;
+}
+
+bool CompiledProgram::play(ApplicationState& state, const File& file)
+{
+    Reader reader(file);
+    if (!reader.openedOk())
+    {
+        return false;
+    }
+    
+    // delays are added up from the start, so waking up late for one of them
+    // doesn't push back all the ones that follow
+    auto start = state.getMicrosecondCounter();
+    int64 elapsed = 0;
+    
+    const uint8* message;
+    int size;
+    int64 delay;
+    while (reader.next(message, size, delay))
+    {
+        if (size == 0)
+        {
+            elapsed += delay;
+            state.waitForMicrosecondCounter(start + elapsed);
+        }
+        else
+        {
+            state.sendMidiMessage(MidiMessage(message, size));
+        }
+    }
+    return !reader.failed();
+}
+
+int64 CompiledProgram::countMessages(const File& file)
+{
+    Reader reader(file);
+    if (!reader.openedOk())
+    {
+        return -1;
+    }
+    
+    int64 messages = 0;
+    const uint8* message;
+    int size;
+    int64 delay;
+    while (reader.next(message, size, delay))
+    {
+        messages += size > 0;
+    }
+    return reader.failed() ? -1 : messages;
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+class ApplicationState;
+
+// A program file that has been run through the parser once, ahead of time,
+// and stored as the MIDI bytes it sends and the delays in between, so that
+// playing it back doesn't parse any text.
+//
+// The file starts with the four bytes "SMCP" and a format version byte,
+// followed by records that each start with an unsigned LEB128 number: a
+// non-zero number is the size of a MIDI message whose bytes follow, zero is
+// followed by another LEB128 number with a delay in microseconds.
+class CompiledProgram
+{
+public:
+    static const int VERSION = 1;
+    
+    class Writer
+    {
+    public:
+        explicit Writer(const File& file);
+        
+        bool openedOk() const;
+        void addMessage(const MidiMessage& msg);
+        void addDelay(int64 microseconds);
+        
+        // writes what's left and moves the finished program into place
+        bool finish();
+        
+    private:
+        void writeNumber(uint64 value);
+        void flushDelay();
+        
+        TemporaryFile file_;
+        std::unique_ptr<FileOutputStream> out_;
+        int64 pendingDelay_ { 0 };
+    };
+    
+    // memory maps a compiled program and goes through its records one by one
+    class Reader
+    {
+    public:
+        explicit Reader(const File& file);
+        
+        // false when the file isn't a compiled program
+        bool openedOk() const;
+        
+        // reads the next record: either the bytes of a message, or a delay in
+        // microseconds with no message; returns false at the end, and when
+        // the program is cut short, which failed() tells apart
+        bool next(const uint8*& message, int& size, int64& delay);
+        bool failed() const;
+        
+    private:
+        MemoryMappedFile mapped_;
+        const uint8* pos_ { nullptr };
+        const uint8* end_ { nullptr };
+        bool failed_ { false };
+    };
+    
+    // memory maps a compiled program and sends it through the state, waiting
+    // out its delays; returns false when the file isn't a compiled program
+    static bool play(ApplicationState& state, const File& file);
+    
+    // the number of messages in a compiled program, or -1 when the file
+    // isn't one
+    static int64 countMessages(const File& file);
+};
@@ -0,0 +1,188 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DeviceRegistry.h"
+
+DeviceRegistry::DeviceRegistry(Direction direction)
+: direction_(direction)
+{
+}
+
+const Array<MidiDeviceInfo>& DeviceRegistry::getDevices()
+{
+    update();
+    return devices_;
+}
+
+const StringArray& DeviceRegistry::getDisplayNames()
+{
+    update();
+    return displayNames_;
+}
+
+int DeviceRegistry::find(const String& name)
+{
+    return resolve(name, false);
+}
+
+std::optional<MidiDeviceInfo> DeviceRegistry::findDevice(const String& name)
+{
+    auto index = resolve(name, false);
+    if (index < 0)
+    {
+        return std::nullopt;
+    }
+    return devices_[index];
+}
+
+int DeviceRegistry::findByName(const String& name)
+{
+    return resolve(name, true);
+}
+
+void DeviceRegistry::setDevices(const Array<MidiDeviceInfo>& devices)
+{
+    devices_ = devices;
+    valid_ = true;
+    fixed_ = true;
+    index();
+}
+
+void DeviceRegistry::invalidate()
+{
+    valid_ = false;
+    fixed_ = false;
+}
+
+StringArray DeviceRegistry::displayNames(const Array<MidiDeviceInfo>& devices)
+{
+    // count the ports of every name first, so that numbering a port only
+    // needs the number of ports with its name that came before it
+    std::unordered_map<String, int> totals;
+    for (auto&& device : devices)
+    {
+        totals[device.name] += 1;
+    }
+
+    std::unordered_map<String, int> positions;
+    StringArray names;
+    names.ensureStorageAllocated(devices.size());
+    for (auto&& device : devices)
+    {
+        if (totals[device.name] > 1)
+        {
+            names.add(device.name + " (" + String(++positions[device.name]) + ")");
+        }
+        else
+        {
+            names.add(device.name);
+        }
+    }
+    return names;
+}
+
+bool DeviceRegistry::isCurrent() const
+{
+    if (!valid_)
+    {
+        return false;
+    }
+    return fixed_ || (changeCount_ >= 0 && changeCount_ == MidiDeviceListConnection::getChangeCount());
+}
+
+bool DeviceRegistry::update()
+{
+    if (isCurrent())
+    {
+        return false;
+    }
+    refresh();
+    return true;
+}
+
+void DeviceRegistry::refresh()
+{
+    if (MidiDeviceListConnection::getChangeCount() >= 0 && !tracking_.has_value())
+    {
+        tracking_ = MidiDeviceListConnection::make(nullptr);
+    }
+
+    // the count is taken before listing, so that a change while listing has
+    // the next lookup list the ports again
+    changeCount_ = MidiDeviceListConnection::getChangeCount();
+    devices_ = direction_ == INPUTS ? MidiInput::getAvailableDevices() : MidiOutput::getAvailableDevices();
+    valid_ = true;
+    fixed_ = false;
+    index();
+}
+
+void DeviceRegistry::index()
+{
+    displayNames_ = displayNames(devices_);
+    byDisplayName_.clear();
+    byName_.clear();
+    for (int i = 0; i < devices_.size(); ++i)
+    {
+        // emplace keeps the first port when names are the same
+        byDisplayName_.emplace(displayNames_[i], i);
+        byName_.emplace(devices_[i].name, i);
+    }
+}
+
+int DeviceRegistry::resolve(const String& name, bool exactNameOnly)
+{
+    auto listed = update();
+    auto index = lookUp(name, exactNameOnly);
+    if (index < 0 && !listed && !fixed_)
+    {
+        // the port may be so new that its announcement hasn't come in yet
+        refresh();
+        index = lookUp(name, exactNameOnly);
+    }
+    return index;
+}
+
+int DeviceRegistry::lookUp(const String& name, bool exactNameOnly) const
+{
+    if (!exactNameOnly)
+    {
+        auto display = byDisplayName_.find(name);
+        if (display != byDisplayName_.end())
+        {
+            return display->second;
+        }
+    }
+
+    auto exact = byName_.find(name);
+    if (exact != byName_.end())
+    {
+        return exact->second;
+    }
+
+    if (!exactNameOnly)
+    {
+        for (int i = 0; i < devices_.size(); ++i)
+        {
+            if (devices_[i].name.containsIgnoreCase(name))
+            {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
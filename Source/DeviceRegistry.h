@@ -0,0 +1,85 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <optional>
+#include <unordered_map>
+
+#include "JuceHeader.h"
+
+// The MIDI ports of one direction, listed once and kept until the system
+// announces that ports came, went or changed, with their names indexed so
+// that a name is resolved without walking the ports again. Where the system
+// can't tell about changes, the ports are listed again for every lookup.
+class DeviceRegistry
+{
+public:
+    enum Direction
+    {
+        OUTPUTS,
+        INPUTS
+    };
+
+    explicit DeviceRegistry(Direction direction);
+
+    const Array<MidiDeviceInfo>& getDevices();
+    const StringArray& getDisplayNames();
+
+    // finds the device a name refers to: first as one of the display names,
+    // then as an exact port name, then as a piece of a port name, ignoring
+    // case; returns -1 when nothing matches
+    int find(const String& name);
+
+    // the device find picks, taken from the same list the lookup used, so a
+    // change that's announced in between can't swap it for another port
+    std::optional<MidiDeviceInfo> findDevice(const String& name);
+
+    // finds the first device with exactly this port name, -1 when there's none
+    int findByName(const String& name);
+
+    // uses these devices instead of the system's ones, until invalidated
+    void setDevices(const Array<MidiDeviceInfo>& devices);
+
+    // lists the ports again at the next lookup
+    void invalidate();
+
+    // the names to show for these MIDI devices: ports that share the same
+    // name get a number appended, like "sooperlooper (2)", so each of them
+    // can be told apart and selected
+    static StringArray displayNames(const Array<MidiDeviceInfo>& devices);
+
+private:
+    bool isCurrent() const;
+    bool update();
+    void refresh();
+    void index();
+    int resolve(const String& name, bool exactNameOnly);
+    int lookUp(const String& name, bool exactNameOnly) const;
+
+    Direction direction_;
+    bool valid_ { false };
+    bool fixed_ { false };              // set through setDevices
+    int64 changeCount_ { -1 };
+    std::optional<MidiDeviceListConnection> tracking_;  // keeps the system's announcements coming in
+
+    Array<MidiDeviceInfo> devices_;
+    StringArray displayNames_;
+    std::unordered_map<String, int> byDisplayName_;
+    std::unordered_map<String, int> byName_;   // to the first port with the name
+};
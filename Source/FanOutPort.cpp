@@ -0,0 +1,169 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FanOutPort.h"
+
+FanOutPort::FanOutPort(std::vector<std::unique_ptr<MidiPort>> ports)
+{
+    for (auto& port : ports)
+    {
+        queues_.push_back(std::make_unique<Queue>(std::move(port)));
+    }
+}
+
+FanOutPort::~FanOutPort() = default;
+
+void FanOutPort::sendMessageNow(const MidiMessage& msg)
+{
+    for (auto& queue : queues_)
+    {
+        queue->push(msg);
+    }
+}
+
+void FanOutPort::sendBlockOfMessagesNow(const MidiBuffer& messages)
+{
+    for (const auto metadata : messages)
+    {
+        sendMessageNow(metadata.getMessage());
+    }
+}
+
+bool FanOutPort::waitUntilDrained(int timeoutMilliseconds)
+{
+    auto deadline = Time::getMillisecondCounter() + (uint32)jmax(0, timeoutMilliseconds);
+    auto remaining = [deadline]
+    {
+        return jmax(0, (int)(deadline - Time::getMillisecondCounter()));
+    };
+
+    // the ports send their queues at the same time, so the slowest one sets
+    // how long this takes
+    for (auto& queue : queues_)
+    {
+        if (!queue->waitUntilSent(remaining()))
+        {
+            return false;
+        }
+    }
+    for (auto& queue : queues_)
+    {
+        if (!queue->getPort().waitUntilDrained(remaining()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FanOutPort::drainsToWire() const
+{
+    for (auto& queue : queues_)
+    {
+        if (!queue->getPort().drainsToWire())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int64 FanOutPort::getRunningStatusBytesSaved() const
+{
+    int64 saved = 0;
+    for (auto& queue : queues_)
+    {
+        // a port only knows once it has sent what's queued for it
+        queue->waitUntilSent(-1);
+        saved += queue->getPort().getRunningStatusBytesSaved();
+    }
+    return saved;
+}
+
+FanOutPort::Queue::Queue(std::unique_ptr<MidiPort> port)
+: Thread("FanOutPort"), port_(std::move(port)), messages_(QUEUE_SIZE)
+{
+    startThread(Priority::high);
+}
+
+FanOutPort::Queue::~Queue()
+{
+    // the messages that are still queued go out before the port is closed
+    waitUntilSent(-1);
+    signalThreadShouldExit();
+    queued_.signal();
+    stopThread(-1);
+}
+
+void FanOutPort::Queue::push(const MidiMessage& msg)
+{
+    while (fifo_.getFreeSpace() == 0)
+    {
+        sent_.wait(1);
+    }
+
+    int start1, size1, start2, size2;
+    fifo_.prepareToWrite(1, start1, size1, start2, size2);
+    messages_[(size_t)start1] = msg;
+    fifo_.finishedWrite(1);
+    queued_.signal();
+}
+
+bool FanOutPort::Queue::waitUntilSent(int timeoutMilliseconds)
+{
+    auto deadline = Time::getMillisecondCounter() + (uint32)jmax(0, timeoutMilliseconds);
+    while (fifo_.getNumReady() > 0)
+    {
+        if (timeoutMilliseconds >= 0 && (int)(deadline - Time::getMillisecondCounter()) <= 0)
+        {
+            return false;
+        }
+        sent_.wait(1);
+    }
+    return true;
+}
+
+void FanOutPort::Queue::run()
+{
+    while (!threadShouldExit())
+    {
+        auto ready = fifo_.getNumReady();
+        if (ready == 0)
+        {
+            queued_.wait(100);
+            continue;
+        }
+
+        // the messages stay in the queue until the port has them, so that
+        // waiting for an empty queue also waits for the ones in flight
+        int start1, size1, start2, size2;
+        fifo_.prepareToRead(ready, start1, size1, start2, size2);
+        for (int i = 0; i < size1; ++i)
+        {
+            block_.addEvent(messages_[(size_t)(start1 + i)], 0);
+        }
+        for (int i = 0; i < size2; ++i)
+        {
+            block_.addEvent(messages_[(size_t)(start2 + i)], 0);
+        }
+        port_->sendBlockOfMessagesNow(block_);
+        block_.clear();
+        fifo_.finishedRead(ready);
+        sent_.signal();
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "MidiPort.h"
+
+// Sends the same messages to several ports at once. Every port has a thread
+// of its own that takes the messages from a lock-free queue, with the sender
+// as the only producer, so that a slow port like a DIN interface only holds
+// up its own messages. The sender only waits for a port when that port's
+// queue is full.
+class FanOutPort : public MidiPort
+{
+public:
+    explicit FanOutPort(std::vector<std::unique_ptr<MidiPort>> ports);
+    ~FanOutPort() override;
+
+    void sendMessageNow(const MidiMessage& msg) override;
+    void sendBlockOfMessagesNow(const MidiBuffer& messages) override;
+    bool waitUntilDrained(int timeoutMilliseconds) override;
+    bool drainsToWire() const override;
+    int64 getRunningStatusBytesSaved() const override;
+
+    int getNumPorts() const { return (int)queues_.size(); }
+
+private:
+    class Queue : private Thread
+    {
+    public:
+        explicit Queue(std::unique_ptr<MidiPort> port);
+        ~Queue() override;
+
+        // queues a message, blocking while the queue is full
+        void push(const MidiMessage& msg);
+
+        // blocks until the port has been handed every queued message, returns
+        // false when it timed out; a negative timeout waits for as long as it takes
+        bool waitUntilSent(int timeoutMilliseconds);
+
+        MidiPort& getPort() { return *port_; }
+        const MidiPort& getPort() const { return *port_; }
+
+    private:
+        void run() override;
+
+        static const int QUEUE_SIZE = 1024;
+
+        std::unique_ptr<MidiPort> port_;
+        AbstractFifo fifo_ { QUEUE_SIZE };
+        std::vector<MidiMessage> messages_;
+        WaitableEvent queued_;
+        WaitableEvent sent_;
+        MidiBuffer block_;              // only used on the queue's thread
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+};
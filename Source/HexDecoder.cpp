@@ -0,0 +1,172 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HexDecoder.h"
+
+// SSE2 is always there on 64-bit Intel, a 32-bit build only gets it when it's
+// compiled for it; AVX2 is compiled in as well and only used when the
+// processor has it
+#if JUCE_INTEL && (defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2))
+ #define HEX_DECODER_SSE2 1
+ #include <immintrin.h>
+ #if defined (__GNUC__) || defined (__clang__)
+  #define HEX_DECODER_AVX2 1
+  #define HEX_DECODER_TARGET_AVX2 __attribute__ ((target ("avx2")))
+ #elif defined (_MSC_VER)
+  #define HEX_DECODER_AVX2 1
+  #define HEX_DECODER_TARGET_AVX2
+ #endif
+#endif
+
+static int hexDigitValue(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    c = (char)(c | 0x20);
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+size_t HexDecoder::decodeScalar(const char* hex, size_t length, uint8* out, bool sevenBit)
+{
+    size_t i = 0;
+    for (; i + 1 < length; i += 2)
+    {
+        auto high = hexDigitValue(hex[i]);
+        auto low = hexDigitValue(hex[i + 1]);
+        if (high < 0 || low < 0 || (sevenBit && high > 7))
+        {
+            return i;
+        }
+        out[i / 2] = (uint8)((high << 4) | low);
+    }
+    return i;
+}
+
+#if HEX_DECODER_SSE2
+
+// the values of the hex digits in each byte, with the bytes that are hex
+// digits marked in valid; the comparisons are unsigned through a saturating
+// subtraction, which SSE2 doesn't have otherwise
+static inline __m128i hexValues(__m128i chars, __m128i& valid)
+{
+    const auto zero = _mm_setzero_si128();
+    const auto digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    const auto isDigit = _mm_cmpeq_epi8(_mm_subs_epu8(digits, _mm_set1_epi8(9)), zero);
+    const auto letters = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    const auto isLetter = _mm_cmpeq_epi8(_mm_subs_epu8(letters, _mm_set1_epi8(5)), zero);
+    valid = _mm_or_si128(isDigit, isLetter);
+    return _mm_or_si128(_mm_and_si128(isDigit, digits),
+                        _mm_and_si128(isLetter, _mm_add_epi8(letters, _mm_set1_epi8(10))));
+}
+
+// each pair of digit values, the high one first, as a byte in the low half
+// of its 16-bit lane
+static inline __m128i pairUp(__m128i values)
+{
+    const auto high = _mm_and_si128(_mm_slli_epi16(values, 4), _mm_set1_epi16(0x00f0));
+    return _mm_or_si128(high, _mm_srli_epi16(values, 8));
+}
+
+// decodes 32 digits at a time and stops at the first block with a problem,
+// which the scalar decoder then goes through to find the pair at fault
+static size_t decodeSSE2(const char* hex, size_t length, uint8* out, bool sevenBit)
+{
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m128i valid1, valid2;
+        const auto values1 = hexValues(_mm_loadu_si128((const __m128i*)(hex + i)), valid1);
+        const auto values2 = hexValues(_mm_loadu_si128((const __m128i*)(hex + i + 16)), valid2);
+        const auto bytes = _mm_packus_epi16(pairUp(values1), pairUp(values2));
+        if (_mm_movemask_epi8(_mm_and_si128(valid1, valid2)) != 0xffff ||
+            (sevenBit && _mm_movemask_epi8(bytes) != 0))
+        {
+            break;
+        }
+        _mm_storeu_si128((__m128i*)(out + i / 2), bytes);
+    }
+    return i;
+}
+
+#endif
+
+#if HEX_DECODER_AVX2
+
+HEX_DECODER_TARGET_AVX2 static inline __m256i hexValues(__m256i chars, __m256i& valid)
+{
+    const auto zero = _mm256_setzero_si256();
+    const auto digits = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+    const auto isDigit = _mm256_cmpeq_epi8(_mm256_subs_epu8(digits, _mm256_set1_epi8(9)), zero);
+    const auto letters = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    const auto isLetter = _mm256_cmpeq_epi8(_mm256_subs_epu8(letters, _mm256_set1_epi8(5)), zero);
+    valid = _mm256_or_si256(isDigit, isLetter);
+    return _mm256_or_si256(_mm256_and_si256(isDigit, digits),
+                           _mm256_and_si256(isLetter, _mm256_add_epi8(letters, _mm256_set1_epi8(10))));
+}
+
+HEX_DECODER_TARGET_AVX2 static inline __m256i pairUp(__m256i values)
+{
+    const auto high = _mm256_and_si256(_mm256_slli_epi16(values, 4), _mm256_set1_epi16(0x00f0));
+    return _mm256_or_si256(high, _mm256_srli_epi16(values, 8));
+}
+
+HEX_DECODER_TARGET_AVX2 static size_t decodeAVX2(const char* hex, size_t length, uint8* out, bool sevenBit)
+{
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64)
+    {
+        __m256i valid1, valid2;
+        const auto values1 = hexValues(_mm256_loadu_si256((const __m256i*)(hex + i)), valid1);
+        const auto values2 = hexValues(_mm256_loadu_si256((const __m256i*)(hex + i + 32)), valid2);
+        // the packing stays within the 128-bit halves, which leaves the
+        // quarters in the order 0 2 1 3
+        const auto packed = _mm256_packus_epi16(pairUp(values1), pairUp(values2));
+        const auto bytes = _mm256_permute4x64_epi64(packed, 0xd8);
+        if (_mm256_movemask_epi8(_mm256_and_si256(valid1, valid2)) != -1 ||
+            (sevenBit && _mm256_movemask_epi8(bytes) != 0))
+        {
+            break;
+        }
+        _mm256_storeu_si256((__m256i*)(out + i / 2), bytes);
+    }
+    return i;
+}
+
+#endif
+
+size_t HexDecoder::decode(const char* hex, size_t length, uint8* out, bool sevenBit)
+{
+    size_t done = 0;
+#if HEX_DECODER_AVX2
+    static const bool hasAVX2 = SystemStats::hasAVX2();
+    if (hasAVX2)
+    {
+        done = decodeAVX2(hex, length, out, sevenBit);
+    }
+#endif
+#if HEX_DECODER_SSE2
+    done += decodeSSE2(hex + done, length - done, out + done / 2, sevenBit);
+#endif
+    return done + decodeScalar(hex + done, length - done, out + done / 2, sevenBit);
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// Decodes the hex blobs of syx and raw, like @43104C00, into bytes. On Intel
+// the digits are decoded 64 at a time with AVX2 when the processor has it, or
+// 32 at a time with SSE2, and the rest one pair at a time, so that a blob of
+// megabytes costs about as much as copying it.
+class HexDecoder
+{
+public:
+    // decodes pairs of hex digits, in upper or lower case, into out, which
+    // needs room for half the length; returns the number of characters that
+    // were decoded, which is the length unless a character isn't a hex digit,
+    // the length is odd or, with sevenBit, a byte has its top bit set, and
+    // then it's the position of the pair where that happened
+    static size_t decode(const char* hex, size_t length, uint8* out, bool sevenBit);
+
+    // the same one pair at a time, without SIMD, which the tests and the
+    // benchmarks compare with
+    static size_t decodeScalar(const char* hex, size_t length, uint8* out, bool sevenBit);
+};
@@ -0,0 +1,88 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LineTokenizer.h"
+
+LineTokenizer::LineTokenizer(char* line)
+: pos_(line)
+{
+    if (pos_ != nullptr && *pos_ == '#')
+    {
+        pos_ = nullptr;
+    }
+}
+
+bool LineTokenizer::isBreak(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+bool LineTokenizer::isWhitespaceOnly(const char* start, const char* end)
+{
+    // other whitespace, like form feeds or non-breaking spaces, doesn't break
+    // tokens but a token of only that is still dropped
+    for (CharPointer_UTF8 p(start); p.getAddress() < end;)
+    {
+        if (!CharacterFunctions::isWhitespace(p.getAndAdvance()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* LineTokenizer::next()
+{
+    while (pos_ != nullptr && *pos_ != '\0')
+    {
+        // the breaks and quotes are all ASCII, so the bytes of multi-byte
+        // UTF-8 characters can never be mistaken for them
+        auto start = pos_;
+        auto end = start;
+        auto quoted = false;
+        while (*end != '\0' && (quoted || !isBreak(*end)))
+        {
+            if (*end == '"')
+            {
+                quoted = !quoted;
+            }
+            ++end;
+        }
+        
+        pos_ = *end == '\0' ? nullptr : end + 1;
+        
+        if (end == start || isWhitespaceOnly(start, end))
+        {
+            continue;
+        }
+        
+        while (start < end && *start == '"')
+        {
+            ++start;
+        }
+        while (end > start && *(end - 1) == '"')
+        {
+            --end;
+        }
+        *end = '\0';
+        return start;
+    }
+    
+    pos_ = nullptr;
+    return nullptr;
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// Splits a line of a program file or standard input into its parameters, in
+// place: each token is terminated inside the line's own UTF-8 buffer and
+// handed out as a pointer into it, so no token gets a copy of its own.
+//
+// The rules are those of StringArray::addTokens with quoted strings preserved:
+// tokens break at spaces, tabs and line breaks outside double quotes, tokens
+// made up of whitespace only are dropped, and the quotes at the start and end
+// of a token are trimmed. A line starting with # is a comment.
+class LineTokenizer
+{
+public:
+    // the line has to be null-terminated and stay alive while tokens are used
+    explicit LineTokenizer(char* line);
+    
+    // the next token, or nullptr once the line is used up
+    const char* next();
+    
+private:
+    static bool isBreak(char c);
+    static bool isWhitespaceOnly(const char* start, const char* end);
+    
+    char* pos_;
+};
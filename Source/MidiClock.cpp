@@ -0,0 +1,88 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MidiClock.h"
+
+static const int TICKS_PER_BEAT = 24;
+
+MidiClock::MidiClock(double startBpm, double endBpm, int beats)
+: startBpm_(startBpm), endBpm_(beats > 0 ? endBpm : startBpm), totalTicks_(int64(jmax(0, beats)) * TICKS_PER_BEAT)
+{
+}
+
+// the tempo of each interval moves on by the same step, reaching the end BPM
+// on the last one
+double MidiClock::microsPerTick(int64 tick) const
+{
+    auto bpm = startBpm_;
+    if (totalTicks_ > 2)
+    {
+        bpm += (endBpm_ - startBpm_) * double(tick) / double(totalTicks_ - 2);
+    }
+    return (60.0 * 1000000.0 / bpm) / TICKS_PER_BEAT;
+}
+
+void MidiClock::advance()
+{
+    ++tick_;
+    if (startBpm_ == endBpm_)
+    {
+        offset_ = double(tick_) * microsPerTick(0);
+    }
+    else
+    {
+        offset_ += microsPerTick(tick_ - 1);
+    }
+}
+
+void MidiClock::Stats::add(double intendedMicros, double actualMicros)
+{
+    auto deviation = std::abs(actualMicros - intendedMicros);
+    ++histogram_[(size_t)jlimit(0, BUCKETS - 1, (int)deviation)];
+    ++count_;
+    totalInterval_ += actualMicros;
+    maximumDeviation_ = jmax(maximumDeviation_, deviation);
+}
+
+double MidiClock::Stats::getMeanIntervalMicros() const
+{
+    return count_ == 0 ? 0.0 : totalInterval_ / count_;
+}
+
+double MidiClock::Stats::getPercentileDeviationMicros(double percentile) const
+{
+    auto wanted = (int)std::ceil(percentile / 100.0 * count_);
+    auto seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += histogram_[(size_t)i];
+        if (seen >= wanted && seen > 0)
+        {
+            return (double)i;
+        }
+    }
+    return 0.0;
+}
+
+void MidiClock::Stats::print() const
+{
+    std::cout << "Sent " << count_ << " clock intervals, on average "
+              << String(getMeanIntervalMicros(), 1) << " us long, deviating at p99 "
+              << String(getPercentileDeviationMicros(99.0), 0) << " us and at most "
+              << String(getMaximumDeviationMicros(), 1) << " us" << std::endl;
+}
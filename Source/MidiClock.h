@@ -0,0 +1,71 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// The times of the ticks of a MIDI Timing Clock, 24 per beat, for a number of
+// beats (0 runs until stopped) with a tempo that can ramp evenly from a start
+// to an end BPM over them.
+//
+// Every tick is timed from the first one instead of from the tick before, so
+// rounding never builds up over a long run.
+class MidiClock
+{
+public:
+    MidiClock(double startBpm, double endBpm, int beats);
+
+    bool isRunning() const { return totalTicks_ == 0 || tick_ < totalTicks_; }
+    int64 getTickCount() const { return tick_; }
+
+    // microseconds from the first tick to the next one that's due
+    double getNextTickOffset() const { return offset_; }
+    void advance();
+
+    // how regular the tick intervals turned out compared to the intended ones
+    class Stats
+    {
+    public:
+        void add(double intendedMicros, double actualMicros);
+        void print() const;
+
+        int getCount() const { return count_; }
+        double getMeanIntervalMicros() const;
+        double getPercentileDeviationMicros(double percentile) const;
+        double getMaximumDeviationMicros() const { return maximumDeviation_; }
+
+    private:
+        // deviations per microsecond, so that memory stays the same however
+        // long a clock runs, with everything from 10 ms on in the last one
+        static const int BUCKETS = 10001;
+        std::vector<int> histogram_ = std::vector<int>(BUCKETS, 0);
+        int count_ { 0 };
+        double totalInterval_ { 0.0 };
+        double maximumDeviation_ { 0.0 };
+    };
+
+private:
+    double microsPerTick(int64 tick) const;
+
+    double startBpm_;
+    double endBpm_;
+    int64 totalTicks_;
+    int64 tick_ { 0 };
+    double offset_ { 0.0 };
+};
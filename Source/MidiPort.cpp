@@ -0,0 +1,208 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MidiPort.h"
+
+#if JUCE_LINUX && JUCE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+const char* const MidiPort::RAWMIDI_PREFIX = "rawmidi:";
+
+namespace
+{
+    class JuceMidiPort : public MidiPort
+    {
+    public:
+        explicit JuceMidiPort(std::unique_ptr<MidiOutput> output)
+        : output_(std::move(output))
+        {
+        }
+
+        void sendMessageNow(const MidiMessage& msg) override
+        {
+            output_->sendMessageNow(msg);
+        }
+
+        void sendBlockOfMessagesNow(const MidiBuffer& messages) override
+        {
+            output_->sendBlockOfMessagesNow(messages);
+        }
+
+        bool waitUntilDrained(int timeoutMilliseconds) override
+        {
+            return output_->waitForOutputToDrain(timeoutMilliseconds);
+        }
+
+    private:
+        std::unique_ptr<MidiOutput> output_;
+    };
+
+#if JUCE_LINUX && JUCE_ALSA
+    // Writes the bytes of a whole block of messages with a single write, in
+    // blocking mode, so the driver takes them at the speed of the port.
+    class RawMidiPort : public MidiPort
+    {
+    public:
+        RawMidiPort(snd_rawmidi_t* handle, bool runningStatus)
+        : handle_(handle), runningStatus_(runningStatus)
+        {
+        }
+
+        ~RawMidiPort() override
+        {
+            // wait for the bytes to leave the port, before closing it cuts them off
+            snd_rawmidi_drain(handle_);
+            snd_rawmidi_close(handle_);
+        }
+
+        void sendMessageNow(const MidiMessage& msg) override
+        {
+            bytes_.clear();
+            append(msg.getRawData(), msg.getRawDataSize());
+            write();
+        }
+
+        void sendBlockOfMessagesNow(const MidiBuffer& messages) override
+        {
+            bytes_.clear();
+            for (const auto metadata : messages)
+            {
+                append(metadata.data, metadata.numBytes);
+            }
+            write();
+        }
+
+        // the write blocks until the driver has the bytes, and the drain
+        // until they're out of the port
+        bool waitUntilDrained(int) override
+        {
+            return snd_rawmidi_drain(handle_) >= 0;
+        }
+
+        bool drainsToWire() const override
+        {
+            return true;
+        }
+
+        int64 getRunningStatusBytesSaved() const override
+        {
+            return encoder_.getBytesSaved();
+        }
+
+    private:
+        void append(const uint8* data, int size)
+        {
+            if (runningStatus_)
+            {
+                encoder_.encode(data, size, bytes_);
+            }
+            else
+            {
+                bytes_.insert(bytes_.end(), data, data + size);
+            }
+        }
+
+        void write()
+        {
+            auto data = bytes_.data();
+            auto size = bytes_.size();
+            while (size > 0)
+            {
+                auto written = snd_rawmidi_write(handle_, data, size);
+                if (written < 0)
+                {
+                    if (written == -EINTR || written == -EAGAIN)
+                    {
+                        continue;
+                    }
+                    std::cerr << "Couldn't write to rawmidi device: " << snd_strerror((int)written) << std::endl;
+                    // the device may have missed the status the next message relies on
+                    encoder_.reset();
+                    return;
+                }
+                data += written;
+                size -= (size_t)written;
+            }
+        }
+
+        snd_rawmidi_t* handle_;
+        bool runningStatus_;
+        RunningStatusEncoder encoder_;
+        std::vector<uint8> bytes_;   // reused for every block
+    };
+#endif
+}
+
+std::unique_ptr<MidiPort> MidiPort::wrap(std::unique_ptr<MidiOutput> output)
+{
+    if (output == nullptr)
+    {
+        return nullptr;
+    }
+    return std::make_unique<JuceMidiPort>(std::move(output));
+}
+
+bool MidiPort::isRawMidiSupported()
+{
+#if JUCE_LINUX && JUCE_ALSA
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::unique_ptr<MidiPort> MidiPort::openRawMidi(const String& device, bool runningStatus)
+{
+#if JUCE_LINUX && JUCE_ALSA
+    snd_rawmidi_t* handle = nullptr;
+    if (snd_rawmidi_open(nullptr, &handle, device.toRawUTF8(), 0) < 0 || handle == nullptr)
+    {
+        return nullptr;
+    }
+    return std::make_unique<RawMidiPort>(handle, runningStatus);
+#else
+    ignoreUnused(device, runningStatus);
+    return nullptr;
+#endif
+}
+
+void RunningStatusEncoder::encode(const uint8* data, int size, std::vector<uint8>& output)
+{
+    if (size <= 0)
+    {
+        return;
+    }
+
+    auto status = data[0];
+    if (status >= 0x80 && status < 0xf0)
+    {
+        if (status == status_)
+        {
+            output.insert(output.end(), data + 1, data + size);
+            ++bytesSaved_;
+            return;
+        }
+        status_ = status;
+    }
+    else
+    {
+        status_ = 0;
+    }
+    output.insert(output.end(), data, data + size);
+}
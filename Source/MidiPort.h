@@ -0,0 +1,71 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// The output port that messages are sent to: a JUCE MidiOutput by default,
+// or on Linux an ALSA rawmidi hardware device that takes the MIDI bytes
+// directly, without going through the sequencer.
+class MidiPort
+{
+public:
+    static const char* const RAWMIDI_PREFIX;
+
+    virtual ~MidiPort() = default;
+
+    virtual void sendMessageNow(const MidiMessage& msg) = 0;
+    virtual void sendBlockOfMessagesNow(const MidiBuffer& messages) = 0;
+
+    // waits until the system has taken the messages that were sent, returns
+    // false when it timed out or the port can't tell
+    virtual bool waitUntilDrained(int timeoutMilliseconds) = 0;
+
+    // whether a drained port has also put the bytes on the wire, rather than
+    // only handed them on to a driver that may still be sending them
+    virtual bool drainsToWire() const { return false; }
+
+    // the status bytes that running status left out, zero for ports without it
+    virtual int64 getRunningStatusBytesSaved() const { return 0; }
+
+    static std::unique_ptr<MidiPort> wrap(std::unique_ptr<MidiOutput> output);
+
+    // opens a rawmidi device like "hw:1,0,0"; returns nullptr when it can't
+    // be opened, or when this build has no rawmidi support
+    static std::unique_ptr<MidiPort> openRawMidi(const String& device, bool runningStatus);
+    static bool isRawMidiSupported();
+};
+
+// Leaves out the status byte of a channel message when it's the same as the
+// one of the channel message before it. SysEx, system common and real-time
+// messages reset the running status, so that the channel message after them
+// always carries its status byte again.
+class RunningStatusEncoder
+{
+public:
+    // appends the bytes of one complete message to the output
+    void encode(const uint8* data, int size, std::vector<uint8>& output);
+    void reset() { status_ = 0; }
+
+    int64 getBytesSaved() const { return bytesSaved_; }
+
+private:
+    uint8 status_ { 0 };
+    int64 bytesSaved_ { 0 };
+};
@@ -0,0 +1,365 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MidiScheduler.h"
+
+// below this, the thread yields instead of sleeping, since a sleep can
+// easily overshoot by a millisecond or more
+static const double SPIN_SECONDS = 0.002;
+
+// messages that are due together go out as one block, up to this many, so
+// that the queue doesn't stay full while a long burst is sent
+static const int MAXIMUM_BATCH = 256;
+
+MidiScheduler::MidiScheduler(Sender sender, SendStats* stats, MessageSender messageSender)
+: Thread("MidiScheduler"), sender_(std::move(sender)), stats_(stats), messageSender_(std::move(messageSender)), events_(QUEUE_SIZE)
+{
+    startThread(Priority::highest);
+}
+
+MidiScheduler::~MidiScheduler()
+{
+    signalThreadShouldExit();
+    queued_.signal();
+    stopThread(-1);
+}
+
+void MidiScheduler::schedule(MidiMessage msg, int64 deadline)
+{
+    // a message larger than the limit is only queued on its own
+    auto bytes = msg.getRawDataSize();
+    while (fifo_.getFreeSpace() == 0 ||
+           (queuedBytes_ > 0 && queuedBytes_ + bytes > MAXIMUM_QUEUED_BYTES))
+    {
+        sent_.wait(1);
+    }
+    queuedBytes_ += bytes;
+
+    int start1, size1, start2, size2;
+    fifo_.prepareToWrite(1, start1, size1, start2, size2);
+    auto& event = events_[(size_t)start1];
+    event.message = std::move(msg);
+    event.deadline = deadline;
+    event.bytes = bytes;
+    event.clockBeats = -1;
+    fifo_.finishedWrite(1);
+    queued_.signal();
+}
+
+void MidiScheduler::scheduleClock(double startBpm, double endBpm, int beats, int64 deadline)
+{
+    while (fifo_.getFreeSpace() == 0)
+    {
+        sent_.wait(1);
+    }
+
+    int start1, size1, start2, size2;
+    fifo_.prepareToWrite(1, start1, size1, start2, size2);
+    auto& event = events_[(size_t)start1];
+    event.deadline = deadline;
+    event.bytes = 0;
+    event.clockBeats = jmax(0, beats);
+    event.clockStartBpm = startBpm;
+    event.clockEndBpm = endBpm;
+    fifo_.finishedWrite(1);
+    queued_.signal();
+}
+
+void MidiScheduler::flush()
+{
+    while (fifo_.getNumReady() > 0)
+    {
+        sent_.wait(1);
+    }
+}
+
+void MidiScheduler::finish()
+{
+    while (fifo_.getNumReady() > 0 || clockRunning_)
+    {
+        sent_.wait(1);
+    }
+}
+
+void MidiScheduler::run()
+{
+    while (!threadShouldExit())
+    {
+        auto hasEvent = fifo_.getNumReady() > batched_;
+        if (!hasEvent && clock_ == nullptr)
+        {
+            sendBatch();
+            queued_.wait(100);
+            continue;
+        }
+
+        // the events stay in the queue until they're sent, so that flush also
+        // waits for the ones that are in flight
+        int start1, size1, start2, size2;
+        fifo_.prepareToRead(hasEvent ? batched_ + 1 : 0, start1, size1, start2, size2);
+        auto index = batched_ < size1 ? start1 + batched_ : start2 + batched_ - size1;
+
+        auto tickDeadline = int64(0);
+        if (clock_ != nullptr)
+        {
+            tickDeadline = clockStart_ + Time::secondsToHighResolutionTicks(clock_->getNextTickOffset() / 1000000.0);
+        }
+
+        if (hasEvent && (clock_ == nullptr || events_[(size_t)index].deadline <= tickDeadline))
+        {
+            auto& event = events_[(size_t)index];
+            if (event.deadline > Time::getHighResolutionTicks())
+            {
+                sendBatch();
+                waitUntil(event.deadline, false);
+            }
+            handle(event);
+            if (batched_ >= MAXIMUM_BATCH)
+            {
+                sendBatch();
+            }
+        }
+        else
+        {
+            sendBatch();
+            if (waitUntil(tickDeadline, !hasEvent))
+            {
+                sendClockTick();
+            }
+        }
+    }
+}
+
+void MidiScheduler::handle(Event& event)
+{
+    // a clock event carries no message of its own, so it's told apart before
+    // the message it holds is looked at
+    if (event.clockBeats >= 0)
+    {
+        ++batched_;
+        clock_ = std::make_unique<MidiClock>(event.clockStartBpm, event.clockEndBpm, event.clockBeats);
+        clockStart_ = event.deadline;
+        clockRunning_ = true;
+        return;
+    }
+
+    if (messageSender_ != nullptr && (event.message.isSysEx() || event.message.getRawDataSize() > LARGE_MESSAGE_SIZE))
+    {
+        // sent straight from the queue after the block before it, rather
+        // than copied into a block of its own
+        sendBatch();
+        send(event.message);
+        countSent(event.deadline);
+        event.message = MidiMessage();
+        ++batched_;
+        batchedBytes_ += event.bytes;
+        sendBatch();
+        return;
+    }
+
+    ++batched_;
+    batchedBytes_ += event.bytes;
+
+    if (clock_ != nullptr && event.message.isSongPositionPointer())
+    {
+        // held until the Continue that follows it, so that both go out right
+        // before the same tick; what was held before isn't held back longer
+        releaseHeldMessages(batch_);
+        heldPosition_ = event.message;
+        holdingPosition_ = true;
+        return;
+    }
+
+    if (clock_ != nullptr && (event.message.isMidiStart() || event.message.isMidiContinue()))
+    {
+        heldTransport_ = event.message;
+        holdingTransport_ = true;
+        return;
+    }
+
+    if (clock_ != nullptr && event.message.isMidiStop())
+    {
+        // Stop ends the clock right away, after what it was still holding
+        releaseHeldMessages(batch_);
+        endClock();
+    }
+
+    batch_.addEvent(event.message, 0);
+    countSent(event.deadline);
+
+    // the slot doesn't hold on to the bytes until it's used again
+    event.message = MidiMessage();
+}
+
+void MidiScheduler::countSent(int64 deadline)
+{
+    auto lateness = jmax((int64)0, Time::getHighResolutionTicks() - deadline);
+    ++sentCount_;
+    totalLateness_ += lateness;
+    maximumLateness_ = jmax(maximumLateness_, lateness);
+}
+
+void MidiScheduler::sendBatch()
+{
+    if (batched_ == 0)
+    {
+        return;
+    }
+    if (!batch_.isEmpty())
+    {
+        send(batch_);
+        batch_.clear();
+    }
+    fifo_.finishedRead(batched_);
+    batched_ = 0;
+    queuedBytes_ -= batchedBytes_;
+    batchedBytes_ = 0;
+    sent_.signal();
+}
+
+void MidiScheduler::sendClockTick()
+{
+    // the tick goes out in the same block as a Start or Continue before it,
+    // and a Song Position Pointer before that
+    MidiBuffer tick;
+    if (holdingTransport_)
+    {
+        releaseHeldMessages(tick);
+    }
+    tick.addEvent(MidiMessage::midiClock(), 0);
+    send(tick);
+    auto now = Time::getHighResolutionTicks();
+
+    auto offset = clock_->getNextTickOffset();
+    if (clock_->getTickCount() > 0)
+    {
+        clockStats_.add(offset - previousTickOffset_, Time::highResolutionTicksToSeconds(now - lastTickSentAt_) * 1000000.0);
+    }
+    previousTickOffset_ = offset;
+    lastTickSentAt_ = now;
+
+    clock_->advance();
+    if (!clock_->isRunning())
+    {
+        // a position that no Continue followed isn't held back any longer
+        MidiBuffer rest;
+        releaseHeldMessages(rest);
+        if (!rest.isEmpty())
+        {
+            send(rest);
+        }
+        endClock();
+    }
+}
+
+// the time a block took is shared evenly between its messages
+void MidiScheduler::send(const MidiBuffer& messages)
+{
+    if (stats_ == nullptr)
+    {
+        sender_(messages);
+        return;
+    }
+    auto start = Time::getHighResolutionTicks();
+    sender_(messages);
+    auto ticks = (Time::getHighResolutionTicks() - start) / jmax(1, messages.getNumEvents());
+    for (const auto metadata : messages)
+    {
+        stats_->addMessage(SendStats::kindOf(metadata.data, metadata.numBytes), metadata.numBytes, ticks);
+    }
+}
+
+void MidiScheduler::send(const MidiMessage& message)
+{
+    auto start = Time::getHighResolutionTicks();
+    messageSender_(message);
+    if (stats_ != nullptr)
+    {
+        stats_->addMessage(SendStats::kindOf(message), message.getRawDataSize(), Time::getHighResolutionTicks() - start);
+    }
+}
+
+void MidiScheduler::releaseHeldMessages(MidiBuffer& messages)
+{
+    if (holdingPosition_)
+    {
+        messages.addEvent(heldPosition_, 0);
+        holdingPosition_ = false;
+    }
+    if (holdingTransport_)
+    {
+        messages.addEvent(heldTransport_, 0);
+        holdingTransport_ = false;
+    }
+}
+
+void MidiScheduler::endClock()
+{
+    clock_ = nullptr;
+    clockRunning_ = false;
+    sent_.signal();
+}
+
+// returns false when it was interrupted by a new event, which may be due
+// before the deadline
+bool MidiScheduler::waitUntil(int64 deadline, bool interruptible)
+{
+    const auto spinTicks = (int64)(SPIN_SECONDS * (double)Time::getHighResolutionTicksPerSecond());
+    while (!threadShouldExit())
+    {
+        auto remaining = deadline - Time::getHighResolutionTicks();
+        if (remaining <= 0)
+        {
+            return true;
+        }
+        if (remaining > spinTicks)
+        {
+            auto milliseconds = jmax(1, (int)(Time::highResolutionTicksToSeconds(remaining - spinTicks) * 1000.0));
+            if (queued_.wait(milliseconds) && interruptible)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            Thread::yield();
+        }
+    }
+    return false;
+}
+
+double MidiScheduler::getAverageLatenessMicros() const
+{
+    if (sentCount_ == 0)
+    {
+        return 0.0;
+    }
+    return Time::highResolutionTicksToSeconds(totalLateness_) * 1000000.0 / sentCount_;
+}
+
+double MidiScheduler::getMaximumLatenessMicros() const
+{
+    return Time::highResolutionTicksToSeconds(maximumLateness_) * 1000000.0;
+}
+
+void MidiScheduler::printJitter() const
+{
+    std::cout << "Sent " << sentCount_ << " messages, on average "
+              << String(getAverageLatenessMicros(), 1) << " us after their deadline, at most "
+              << String(getMaximumLatenessMicros(), 1) << " us" << std::endl;
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "MidiClock.h"
+#include "SendStats.h"
+
+// Sends MIDI messages at their deadlines from a high priority thread of its
+// own, so that the parser doesn't block on timestamps and can already prepare
+// the messages that follow. Messages that are due together are sent as one
+// block, which the ALSA output turns into a single drain of its buffer.
+//
+// The parser is the only producer and the scheduler thread the only consumer
+// of a lock-free queue. Deadlines are in high resolution ticks; the thread
+// sleeps until shortly before a deadline and yields for the rest of the way.
+//
+// The queue holds a limited number of messages and of bytes, so that long
+// SysEx messages don't pile up in memory ahead of a slow port. A SysEx, or
+// another message above LARGE_MESSAGE_SIZE, goes out on its own straight
+// from the queue, without being copied into a block, when there's a message
+// sender for it.
+//
+// A MIDI Timing Clock runs on the same thread, in between the queued
+// messages, so it keeps going while the parser carries on with the commands
+// that follow it. Start and Continue wait for the next clock tick while it
+// runs, so that the tick right after them is the first one of the beat, and
+// a Song Position Pointer waits for the Continue after it to go out together.
+// Stop ends the clock, which is how a clock without a beat count finishes.
+class MidiScheduler : private Thread
+{
+public:
+    using Sender = std::function<void(const MidiBuffer&)>;
+    using MessageSender = std::function<void(const MidiMessage&)>;
+
+    static const int LARGE_MESSAGE_SIZE = 4096;
+    static const int64 MAXIMUM_QUEUED_BYTES = 1 << 20;
+
+    // the port's sends are timed in the stats when they're given, which
+    // mustn't be given messages on any other thread then
+    explicit MidiScheduler(Sender sender, SendStats* stats = nullptr, MessageSender messageSender = nullptr);
+    ~MidiScheduler() override;
+
+    // queues a message, blocking while the queue is full or holds too many
+    // bytes to take it; the message is moved into the queue
+    void schedule(MidiMessage msg, int64 deadline);
+
+    // starts a clock at the deadline, replacing one that's still running
+    void scheduleClock(double startBpm, double endBpm, int beats, int64 deadline);
+
+    // blocks until every queued message has been sent, a running clock
+    // carries on
+    void flush();
+
+    // blocks until every queued message has been sent and the clock ended,
+    // which a clock without a beat count only does after a Stop
+    void finish();
+
+    // how late the messages were sent compared to their deadlines, only
+    // consistent after a finish
+    int getSentCount() const { return sentCount_; }
+    double getAverageLatenessMicros() const;
+    double getMaximumLatenessMicros() const;
+    void printJitter() const;
+    const MidiClock::Stats& getClockStats() const { return clockStats_; }
+
+private:
+    struct Event
+    {
+        MidiMessage message;
+        int64 deadline { 0 };
+        int bytes { 0 };
+        // a clock to start instead of a message to send, when the beats aren't negative
+        int clockBeats { -1 };
+        double clockStartBpm { 0.0 };
+        double clockEndBpm { 0.0 };
+    };
+
+    void run() override;
+    bool waitUntil(int64 deadline, bool interruptible);
+    void handle(Event& event);
+    void sendBatch();
+    void sendClockTick();
+    void send(const MidiBuffer& messages);
+    void send(const MidiMessage& message);
+    void countSent(int64 deadline);
+    void releaseHeldMessages(MidiBuffer& messages);
+    void endClock();
+
+    static const int QUEUE_SIZE = 1024;
+
+    Sender sender_;
+    SendStats* stats_;
+    MessageSender messageSender_;
+    AbstractFifo fifo_ { QUEUE_SIZE };
+    std::vector<Event> events_;
+    WaitableEvent queued_;
+    WaitableEvent sent_;
+    std::atomic<int64> queuedBytes_ { 0 };
+
+    // only used on the scheduler thread
+    MidiBuffer batch_;
+    int batched_ { 0 };                 // events handled but still in the queue
+    int64 batchedBytes_ { 0 };
+    std::unique_ptr<MidiClock> clock_;
+    int64 clockStart_ { 0 };
+    int64 lastTickSentAt_ { 0 };
+    double previousTickOffset_ { 0.0 };
+    MidiMessage heldTransport_;
+    bool holdingTransport_ { false };
+    MidiMessage heldPosition_;
+    bool holdingPosition_ { false };
+    std::atomic<bool> clockRunning_ { false };
+    MidiClock::Stats clockStats_;
+
+    int sentCount_ { 0 };
+    int64 totalLateness_ { 0 };
+    int64 maximumLateness_ { 0 };
+};
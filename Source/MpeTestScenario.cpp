@@ -18,16 +18,16 @@
 
 #include "MpeTestScenario.h"
 
-void MpeTestScenario::step(const String& message)
+void MpeTestScenario::step(ApplicationState& state, const String& message)
 {
     std::cout << message << " ";
     for (auto i = 0 ; i < 3; ++i)
     {
-        Thread::sleep(100);
+        state.sleep(100);
         std::cout << ".";
         std::cout.flush();
     }
-    Thread::sleep(300);
+    state.sleep(300);
     std::cout << std::endl;
     std::cout.flush();
 }
@@ -44,18 +44,18 @@ void MpeTestScenario::send(ApplicationState& state)
     const auto timbre_neutral = 0x40;
 
     auto range = 15;
-    step(String("MPE Zone 1 with ") + String(range) + String(" Member Channels"));
+    step(state, String("MPE Zone 1 with ") + String(range) + String(" Member Channels"));
     state.sendRPN(1, 6, range << 7);
     
     auto mgr_pbsens = 7;
-    step(String("Pitch Bend Sensitivity on Manager Channel to ") + String(mgr_pbsens) + " semitones");
+    step(state, String("Pitch Bend Sensitivity on Manager Channel to ") + String(mgr_pbsens) + " semitones");
     state.sendRPN(1, 0, mgr_pbsens << 7);
     
     auto note_pbsens = 48;
-    step(String("Pitch Bend Sensitivity on Member Channels to ") + String(note_pbsens) + " semitones");
+    step(state, String("Pitch Bend Sensitivity on Member Channels to ") + String(note_pbsens) + " semitones");
     state.sendRPN(2, 0, note_pbsens << 7);
     
-    step("Major C triad C3 E3 G3 on Member Channels with neutral starting expression");
+    step(state, "Major C triad C3 E3 G3 on Member Channels with neutral starting expression");
     
     state.sendMidiMessage(MidiMessage::pitchWheel(2, 0x2000));
     state.sendMidiMessage(MidiMessage::controllerEvent(2, 74, timbre_neutral));
@@ -72,9 +72,9 @@ void MpeTestScenario::send(ApplicationState& state)
     state.sendMidiMessage(MidiMessage::channelPressureChange(16, 0));
     state.sendMidiMessage(MidiMessage::noteOn(16, 0x43, (uint8)0x7f));
     
-    Thread::sleep(2000);
+    state.sleep(2000);
     
-    step("Pitch bend into different directions, resulting into G3 E4 C3");
+    step(state, "Pitch bend into different directions, resulting into G3 E4 C3");
     
     auto bend_interval = 7;
     auto ch02_pitch_target = + (0x1FFF * bend_interval / note_pbsens);
@@ -85,12 +85,12 @@ void MpeTestScenario::send(ApplicationState& state)
         state.sendMidiMessage(MidiMessage::pitchWheel(2, 0x2000 + (ch02_pitch_target * i) / bend_messages));
         state.sendMidiMessage(MidiMessage::pitchWheel(3, 0x2000 + (ch03_pitch_target * i) / bend_messages));
         state.sendMidiMessage(MidiMessage::pitchWheel(16, 0x2000 + (ch16_pitch_target * i) / bend_messages));
-        Thread::sleep(1);
+        state.sleep(1);
     }
     
-    Thread::sleep(2000);
+    state.sleep(2000);
     
-    step("Independent pressure across different notes");
+    step(state, "Independent pressure across different notes");
     
     auto ch02_last_pressure = 0;
     auto ch03_last_pressure = 0;
@@ -103,7 +103,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::channelPressureChange(2, ch02_val));
             ch02_last_pressure = ch02_val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     for (auto i = 0; i <= pressure_messages; ++i)
     {
@@ -119,7 +119,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::channelPressureChange(3, ch03_val));
             ch03_last_pressure = ch03_val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     for (auto i = 0; i <= pressure_messages; ++i)
     {
@@ -135,7 +135,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::channelPressureChange(16, ch16_val));
             ch16_last_pressure = ch16_val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     for (auto i = 0; i <= pressure_messages; ++i)
     {
@@ -145,12 +145,12 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::channelPressureChange(16, ch16_val));
             ch16_last_pressure = ch16_val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     
-    Thread::sleep(2000);
+    state.sleep(2000);
     
-    step("Independent timbral motion across different notes");
+    step(state, "Independent timbral motion across different notes");
     
     auto ch02_last_timbre = 0;
     auto ch03_last_timbre = 0;
@@ -163,7 +163,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::controllerEvent(2, 74, ch02_val));
             ch02_last_timbre = ch02_val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     for (auto i = 0; i <= timbre_messages; ++i)
     {
@@ -179,7 +179,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::controllerEvent(3, 74, ch03_val));
             ch03_last_timbre = ch03_val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     for (auto i = 0; i <= timbre_messages; ++i)
     {
@@ -195,7 +195,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::controllerEvent(16, 74, ch16_val));
             ch16_last_timbre = ch16_val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     for (auto i = 0; i <= timbre_messages; ++i)
     {
@@ -205,12 +205,12 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::controllerEvent(16, 74, ch16_val));
             ch16_last_timbre = ch16_val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     
-    Thread::sleep(2000);
+    state.sleep(2000);
     
-    step("Manager Channel pitch bend transposes the whole held chord and returns");
+    step(state, "Manager Channel pitch bend transposes the whole held chord and returns");
 
     // the Manager Channel (channel 1 in the Lower Zone) affects every sounding
     // Member note at once, so this bends the entire chord up and back to center
@@ -218,17 +218,17 @@ void MpeTestScenario::send(ApplicationState& state)
     for (auto i = 1; i <= control_messages; ++i)
     {
         state.sendMidiMessage(MidiMessage::pitchWheel(1, 0x2000 + (mgr_bend_target * i) / control_messages));
-        Thread::sleep(1);
+        state.sleep(1);
     }
     for (auto i = control_messages; i >= 0; --i)
     {
         state.sendMidiMessage(MidiMessage::pitchWheel(1, 0x2000 + (mgr_bend_target * i) / control_messages));
-        Thread::sleep(1);
+        state.sleep(1);
     }
 
-    Thread::sleep(1000);
+    state.sleep(1000);
 
-    step("Manager Channel modulation, expression and pressure applied to all notes");
+    step(state, "Manager Channel modulation, expression and pressure applied to all notes");
 
     // modulation (CC 1) rising from 0 to full
     auto mgr_last = -1;
@@ -240,7 +240,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::controllerEvent(1, 1, val));
             mgr_last = val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     // expression (CC 11) falling from full to 0
     mgr_last = -1;
@@ -252,7 +252,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::controllerEvent(1, 11, val));
             mgr_last = val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     // channel pressure rising from 0 to full
     mgr_last = -1;
@@ -264,12 +264,12 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::channelPressureChange(1, val));
             mgr_last = val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
 
-    Thread::sleep(2000);
+    state.sleep(2000);
 
-    step("Release the active notes");
+    step(state, "Release the active notes");
 
     state.sendMidiMessage(MidiMessage::noteOff(2, 0x3c, (uint8)0x40));
     state.sendMidiMessage(MidiMessage::noteOff(3, 0x40, (uint8)0x40));
@@ -281,9 +281,9 @@ void MpeTestScenario::send(ApplicationState& state)
     state.sendMidiMessage(MidiMessage::controllerEvent(1, 11, 0x7f));
     state.sendMidiMessage(MidiMessage::channelPressureChange(1, 0));
 
-    Thread::sleep(2000);
+    state.sleep(2000);
 
-    step("Pitch bend to the extreme low and high limits on a Member Channel");
+    step(state, "Pitch bend to the extreme low and high limits on a Member Channel");
 
     // a full-scale bend to both rails checks clamping at the sensitivity limit
     state.sendMidiMessage(MidiMessage::pitchWheel(2, 0x2000));
@@ -293,21 +293,21 @@ void MpeTestScenario::send(ApplicationState& state)
     for (auto i = 0; i <= bend_messages; ++i)
     {
         state.sendMidiMessage(MidiMessage::pitchWheel(2, 0x2000 - (0x2000 * i) / bend_messages));
-        Thread::sleep(1);
+        state.sleep(1);
     }
-    Thread::sleep(500);
+    state.sleep(500);
     for (auto i = 0; i <= bend_messages; ++i)
     {
         state.sendMidiMessage(MidiMessage::pitchWheel(2, (0x3FFF * i) / bend_messages));
-        Thread::sleep(1);
+        state.sleep(1);
     }
-    Thread::sleep(500);
+    state.sleep(500);
     state.sendMidiMessage(MidiMessage::pitchWheel(2, 0x2000));
     state.sendMidiMessage(MidiMessage::noteOff(2, 0x3c, (uint8)0x40));
 
-    Thread::sleep(2000);
+    state.sleep(2000);
 
-    step("Multiple notes stacked on a single Member Channel share its expression");
+    step(state, "Multiple notes stacked on a single Member Channel share its expression");
 
     // more notes than channels forces several onto one channel; they can no
     // longer be shaped independently and move together with that channel
@@ -317,7 +317,7 @@ void MpeTestScenario::send(ApplicationState& state)
     state.sendMidiMessage(MidiMessage::noteOn(2, 0x3c, (uint8)0x60));
     state.sendMidiMessage(MidiMessage::noteOn(2, 0x40, (uint8)0x60));
     state.sendMidiMessage(MidiMessage::noteOn(2, 0x43, (uint8)0x60));
-    Thread::sleep(1000);
+    state.sleep(1000);
     auto shared_last = -1;
     for (auto i = 0; i <= pressure_messages; ++i)
     {
@@ -327,7 +327,7 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::channelPressureChange(2, val));
             shared_last = val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     for (auto i = 0; i <= pressure_messages; ++i)
     {
@@ -337,15 +337,15 @@ void MpeTestScenario::send(ApplicationState& state)
             state.sendMidiMessage(MidiMessage::channelPressureChange(2, val));
             shared_last = val;
         }
-        Thread::sleep(1);
+        state.sleep(1);
     }
     state.sendMidiMessage(MidiMessage::noteOff(2, 0x3c, (uint8)0x40));
     state.sendMidiMessage(MidiMessage::noteOff(2, 0x40, (uint8)0x40));
     state.sendMidiMessage(MidiMessage::noteOff(2, 0x43, (uint8)0x40));
     
-    Thread::sleep(2000);
+    state.sleep(2000);
     
-    step("Different Major C triad G3 E4 C3 on Member Channels with neutral starting expression");
+    step(state, "Different Major C triad G3 E4 C3 on Member Channels with neutral starting expression");
     
     state.sendMidiMessage(MidiMessage::pitchWheel(2, 0x2000));
     state.sendMidiMessage(MidiMessage::controllerEvent(2, 74, timbre_neutral));
@@ -362,16 +362,16 @@ void MpeTestScenario::send(ApplicationState& state)
     state.sendMidiMessage(MidiMessage::channelPressureChange(16, 0));
     state.sendMidiMessage(MidiMessage::noteOn(16, 0x3c, (uint8)0x7f));
     
-    Thread::sleep(2000);
+    state.sleep(2000);
     
     note_pbsens = 96;
     
-    step(String("Pitch Bend Sensitivity on Member Channels to ") + String(note_pbsens) + " semitones");
+    step(state, String("Pitch Bend Sensitivity on Member Channels to ") + String(note_pbsens) + " semitones");
     state.sendRPN(2, 0, note_pbsens << 7);
     
-    Thread::sleep(2000);
+    state.sleep(2000);
     
-    step("Pitch bend back to the original Major C triad C3 E3 G3");
+    step(state, "Pitch bend back to the original Major C triad C3 E3 G3");
     
     ch02_pitch_target = - (0x1FFF * bend_interval / note_pbsens);
     ch03_pitch_target = - (0x1FFF * 12 / note_pbsens);
@@ -381,12 +381,12 @@ void MpeTestScenario::send(ApplicationState& state)
         state.sendMidiMessage(MidiMessage::pitchWheel(2, 0x2000 + (ch02_pitch_target * i) / bend_messages));
         state.sendMidiMessage(MidiMessage::pitchWheel(3, 0x2000 + (ch03_pitch_target * i) / bend_messages));
         state.sendMidiMessage(MidiMessage::pitchWheel(16, 0x2000 + (ch16_pitch_target * i) / bend_messages));
-        Thread::sleep(1);
+        state.sleep(1);
     }
     
-    Thread::sleep(2000);
+    state.sleep(2000);
     
-    step("Release the active notes");
+    step(state, "Release the active notes");
     
     state.sendMidiMessage(MidiMessage::noteOff(2, 0x43, (uint8)0x40));
     state.sendMidiMessage(MidiMessage::noteOff(3, 0x4c, (uint8)0x40));
@@ -28,5 +28,5 @@ public:
     void send(ApplicationState& state);
     
 private:
-    void step(const String& message);
+    void step(ApplicationState& state, const String& message);
 };
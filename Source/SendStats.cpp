@@ -0,0 +1,225 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SendStats.h"
+
+SendStats::SendStats()
+: start_(Time::getHighResolutionTicks())
+{
+}
+
+SendStats::Kind SendStats::kindOf(const MidiMessage& msg)
+{
+    return kindOf(msg.getRawData(), msg.getRawDataSize());
+}
+
+SendStats::Kind SendStats::kindOf(const uint8* data, int size)
+{
+    auto status = size > 0 ? data[0] : 0;
+    if (status >= 0x80 && status < 0xf0)
+    {
+        return (Kind)((status >> 4) - 8);
+    }
+    if (status == 0xf0)
+    {
+        return SYSTEM_EXCLUSIVE;
+    }
+    if (status >= 0xf8)
+    {
+        return REAL_TIME;
+    }
+    return SYSTEM_COMMON;
+}
+
+const char* SendStats::getKindName(Kind kind)
+{
+    static const char* const names[KINDS] =
+    {
+        "note-off", "note-on", "poly-pressure", "control-change", "program-change",
+        "channel-pressure", "pitch-bend", "system-exclusive", "system-common", "real-time"
+    };
+    return names[(size_t)kind];
+}
+
+void SendStats::addMessage(const MidiMessage& msg, int64 ticks)
+{
+    addMessage(kindOf(msg), msg.getRawDataSize(), ticks);
+}
+
+void SendStats::addMessage(Kind kind, int size, int64 ticks)
+{
+    auto& histogram = kinds_[(size_t)kind];
+    auto nanos = (int64)(Time::highResolutionTicksToSeconds(ticks) * 1e9);
+    // a send quicker than the tick resolution counts in the lowest bucket
+    auto bucket = findHighestSetBit((uint32)jlimit<int64>(1, (int64)1 << 31, nanos));
+    histogram.buckets[(size_t)bucket] += 1;
+    histogram.count += 1;
+    histogram.bytes += size;
+    histogram.totalTicks += ticks;
+    histogram.maximumTicks = jmax(histogram.maximumTicks, ticks);
+}
+
+int64 SendStats::getMessageCount() const
+{
+    int64 count = 0;
+    for (auto&& histogram : kinds_)
+    {
+        count += histogram.count;
+    }
+    return count;
+}
+
+int64 SendStats::getByteCount() const
+{
+    int64 bytes = 0;
+    for (auto&& histogram : kinds_)
+    {
+        bytes += histogram.bytes;
+    }
+    return bytes;
+}
+
+double SendStats::getMeanMicros(Kind kind) const
+{
+    auto& histogram = kinds_[(size_t)kind];
+    if (histogram.count == 0)
+    {
+        return 0.0;
+    }
+    return Time::highResolutionTicksToSeconds(histogram.totalTicks) * 1000000.0 / (double)histogram.count;
+}
+
+double SendStats::getMaximumMicros(Kind kind) const
+{
+    return Time::highResolutionTicksToSeconds(kinds_[(size_t)kind].maximumTicks) * 1000000.0;
+}
+
+double SendStats::getPercentileMicros(Kind kind, double percentile) const
+{
+    auto& histogram = kinds_[(size_t)kind];
+    if (histogram.count == 0)
+    {
+        return 0.0;
+    }
+    auto target = (int64)std::ceil((double)histogram.count * percentile / 100.0);
+    int64 seen = 0;
+    for (int i = 0; i < BUCKETS - 1; ++i)
+    {
+        seen += histogram.buckets[(size_t)i];
+        if (seen >= target)
+        {
+            return jmin(getBucketEdgeMicros(i), getMaximumMicros(kind));
+        }
+    }
+    return getMaximumMicros(kind);
+}
+
+double SendStats::getElapsedSeconds() const
+{
+    return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start_);
+}
+
+double SendStats::getBucketEdgeMicros(int bucket)
+{
+    return (double)((int64)1 << (bucket + 1)) / 1000.0;
+}
+
+void SendStats::print() const
+{
+    auto seconds = jmax(getElapsedSeconds(), 1e-9);
+    auto messages = getMessageCount();
+    auto bytes = getByteCount();
+    std::cout << "Sent " << messages << " messages, " << bytes << " bytes in " << String(seconds, 3) << " s: "
+              << String((double)messages / seconds, 1) << " messages/s, "
+              << String((double)bytes / seconds, 1) << " bytes/s" << std::endl;
+    std::cout << "Waited " << String(getTimestampWaitSeconds(), 3) << " s for timestamps and "
+              << String(getSysExWaitSeconds(), 3) << " s for SysEx to go out" << std::endl;
+    if (messages == 0)
+    {
+        return;
+    }
+    if (timing_ == PORT_SENDS)
+    {
+        std::cout << "Time the port took to send a message, per kind:" << std::endl;
+    }
+    else
+    {
+        std::cout << "Time to hand over a message, per kind:" << std::endl;
+    }
+    for (int k = 0; k < KINDS; ++k)
+    {
+        auto kind = (Kind)k;
+        if (getMessageCount(kind) == 0)
+        {
+            continue;
+        }
+        std::cout << "  " << String(getKindName(kind)).paddedRight(' ', 18)
+                  << String(getMessageCount(kind)).paddedLeft(' ', 8)
+                  << "  mean " << String(getMeanMicros(kind), 1) << " us"
+                  << "  p50 " << String(getPercentileMicros(kind, 50.0), 1) << " us"
+                  << "  p99 " << String(getPercentileMicros(kind, 99.0), 1) << " us"
+                  << "  max " << String(getMaximumMicros(kind), 1) << " us" << std::endl;
+    }
+}
+
+var SendStats::toVar() const
+{
+    auto seconds = jmax(getElapsedSeconds(), 1e-9);
+    DynamicObject::Ptr result = new DynamicObject();
+    result->setProperty("messages", getMessageCount());
+    result->setProperty("bytes", getByteCount());
+    result->setProperty("seconds", seconds);
+    result->setProperty("messagesPerSecond", (double)getMessageCount() / seconds);
+    result->setProperty("bytesPerSecond", (double)getByteCount() / seconds);
+    result->setProperty("timestampWaitSeconds", getTimestampWaitSeconds());
+    result->setProperty("sysExWaitSeconds", getSysExWaitSeconds());
+    result->setProperty("timing", timing_ == PORT_SENDS ? "port-sends" : "hand-over");
+
+    DynamicObject::Ptr kinds = new DynamicObject();
+    for (int k = 0; k < KINDS; ++k)
+    {
+        auto kind = (Kind)k;
+        auto& histogram = kinds_[(size_t)k];
+        if (histogram.count == 0)
+        {
+            continue;
+        }
+        DynamicObject::Ptr stats = new DynamicObject();
+        stats->setProperty("messages", histogram.count);
+        stats->setProperty("bytes", histogram.bytes);
+        stats->setProperty("meanMicros", getMeanMicros(kind));
+        stats->setProperty("p50Micros", getPercentileMicros(kind, 50.0));
+        stats->setProperty("p99Micros", getPercentileMicros(kind, 99.0));
+        stats->setProperty("maxMicros", getMaximumMicros(kind));
+
+        // the counts per bucket, keyed by the bucket's upper edge
+        DynamicObject::Ptr buckets = new DynamicObject();
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            if (histogram.buckets[(size_t)i] > 0)
+            {
+                auto edge = i < BUCKETS - 1 ? String(getBucketEdgeMicros(i), 3) : String("more");
+                buckets->setProperty(Identifier(edge), histogram.buckets[(size_t)i]);
+            }
+        }
+        stats->setProperty("histogramMicros", buckets.get());
+        kinds->setProperty(getKindName(kind), stats.get());
+    }
+    result->setProperty("kinds", kinds.get());
+    return result.get();
+}
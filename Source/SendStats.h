@@ -0,0 +1,106 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// What sending achieved: how long each message took, per kind of message, the
+// messages and bytes per second, and how long the commands waited for their
+// timestamps and for SysEx to go out. It's only created for the "--stats"
+// options, so nothing is timed otherwise.
+//
+// With a port, the scheduler thread times the port's sends, sharing the time
+// of a block evenly between its messages; when the messages are collected or
+// compiled, it's the time to hand each one over that's timed instead.
+class SendStats
+{
+public:
+    enum Kind
+    {
+        NOTE_OFF,
+        NOTE_ON,
+        POLY_PRESSURE,
+        CONTROL_CHANGE,
+        PROGRAM_CHANGE,
+        CHANNEL_PRESSURE,
+        PITCH_BEND,
+        SYSTEM_EXCLUSIVE,
+        SYSTEM_COMMON,
+        REAL_TIME,
+        KINDS
+    };
+
+    enum Timing
+    {
+        HAND_OVER,
+        PORT_SENDS
+    };
+
+    SendStats();
+
+    // what the per kind durations are of, for the report
+    void setTiming(Timing timing) { timing_ = timing; }
+    Timing getTiming() const { return timing_; }
+
+    static Kind kindOf(const MidiMessage& msg);
+    static Kind kindOf(const uint8* data, int size);
+    static const char* getKindName(Kind kind);
+
+    // durations are in high resolution ticks
+    void addMessage(const MidiMessage& msg, int64 ticks);
+    void addMessage(Kind kind, int size, int64 ticks);
+    void addTimestampWait(int64 ticks) { timestampWaitTicks_ += ticks; }
+    void addSysExWait(int64 ticks) { sysExWaitTicks_ += ticks; }
+
+    int64 getMessageCount() const;
+    int64 getByteCount() const;
+    int64 getMessageCount(Kind kind) const { return kinds_[(size_t)kind].count; }
+    double getMeanMicros(Kind kind) const;
+    double getMaximumMicros(Kind kind) const;
+    // the upper edge of the histogram bucket the percentile falls in
+    double getPercentileMicros(Kind kind, double percentile) const;
+    double getTimestampWaitSeconds() const { return Time::highResolutionTicksToSeconds(timestampWaitTicks_); }
+    double getSysExWaitSeconds() const { return Time::highResolutionTicksToSeconds(sysExWaitTicks_); }
+    double getElapsedSeconds() const;
+
+    void print() const;
+    var toVar() const;
+
+private:
+    // durations per power of two nanoseconds, from below 2 ns to above two
+    // seconds in the last one
+    static const int BUCKETS = 32;
+
+    struct Histogram
+    {
+        std::array<int64, BUCKETS> buckets {};
+        int64 count { 0 };
+        int64 bytes { 0 };
+        int64 totalTicks { 0 };
+        int64 maximumTicks { 0 };
+    };
+
+    static double getBucketEdgeMicros(int bucket);
+
+    std::array<Histogram, KINDS> kinds_;
+    int64 start_;
+    int64 timestampWaitTicks_ { 0 };
+    int64 sysExWaitTicks_ { 0 };
+    Timing timing_ { HAND_OVER };
+};
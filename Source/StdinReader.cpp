@@ -0,0 +1,150 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StdinReader.h"
+
+#if JUCE_WINDOWS
+ #include <io.h>
+#else
+ #include <unistd.h>
+#endif
+
+static int readInput(int fd, char* buffer, int size)
+{
+#if JUCE_WINDOWS
+    return _read(fd, buffer, (unsigned int)size);
+#else
+    for (;;)
+    {
+        auto result = ::read(fd, buffer, (size_t)size);
+        if (result >= 0 || errno != EINTR)
+        {
+            return (int)result;
+        }
+    }
+#endif
+}
+
+StdinReader::StdinReader(int fd, int chunkSize, int chunkCount)
+: Thread("StdinReader"), fd_(fd), fifo_(chunkCount), chunks_((size_t)chunkCount)
+{
+    for (auto& chunk : chunks_)
+    {
+        chunk.data.resize((size_t)chunkSize);
+    }
+    startThread();
+}
+
+StdinReader::~StdinReader()
+{
+    // the thread is normally done once the input was closed, a read that's
+    // still blocked is given up on
+    signalThreadShouldExit();
+    emptied_.signal();
+    stopThread(100);
+}
+
+bool StdinReader::nextLine(std::string& line)
+{
+    line.clear();
+    auto partial = false;
+    for (;;)
+    {
+        if (current_ == nullptr && !takeChunk())
+        {
+            // the last line doesn't need a line break
+            return partial;
+        }
+        
+        auto begin = current_->data.data() + position_;
+        auto end = current_->data.data() + current_->size;
+        auto lineBreak = static_cast<const char*>(std::memchr(begin, '\n', (size_t)(end - begin)));
+        if (lineBreak != nullptr)
+        {
+            line.append(begin, lineBreak);
+            position_ = (int)(lineBreak + 1 - current_->data.data());
+            if (position_ == current_->size)
+            {
+                releaseChunk();
+            }
+            return true;
+        }
+        
+        line.append(begin, end);
+        partial = true;
+        releaseChunk();
+    }
+}
+
+void StdinReader::run()
+{
+    while (!threadShouldExit())
+    {
+        if (fifo_.getFreeSpace() == 0)
+        {
+            emptied_.wait(100);
+            continue;
+        }
+        
+        int start1, size1, start2, size2;
+        fifo_.prepareToWrite(1, start1, size1, start2, size2);
+        auto& chunk = chunks_[(size_t)start1];
+        auto result = readInput(fd_, chunk.data.data(), (int)chunk.data.size());
+        chunk.size = jmax(0, result);
+        fifo_.finishedWrite(1);
+        filled_.signal();
+        
+        if (result <= 0)
+        {
+            return;
+        }
+    }
+}
+
+// waits for the next chunk, or returns false at the end of the input
+bool StdinReader::takeChunk()
+{
+    if (ended_)
+    {
+        return false;
+    }
+    
+    while (fifo_.getNumReady() == 0)
+    {
+        filled_.wait(100);
+    }
+    
+    int start1, size1, start2, size2;
+    fifo_.prepareToRead(1, start1, size1, start2, size2);
+    current_ = &chunks_[(size_t)start1];
+    position_ = 0;
+    if (current_->size == 0)
+    {
+        releaseChunk();
+        ended_ = true;
+        return false;
+    }
+    return true;
+}
+
+void StdinReader::releaseChunk()
+{
+    current_ = nullptr;
+    fifo_.finishedRead(1);
+    emptied_.signal();
+}
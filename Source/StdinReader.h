@@ -0,0 +1,64 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// Reads standard input for "--" on a thread of its own, so that the program
+// writing the commands isn't held up on a full pipe while the parser waits for
+// a timestamp or paces SysEx. The thread fills large chunks with read(2) and
+// hands them to the parser, which takes the lines out of them and passes its
+// messages on to the MidiScheduler, so reading, parsing and sending each run
+// at their own pace.
+//
+// The reader thread is the only producer and the parser the only consumer of
+// a lock-free queue of chunks; when all of them are full, the reader waits
+// for the parser to finish one.
+class StdinReader : private Thread
+{
+public:
+    explicit StdinReader(int fd = 0, int chunkSize = 65536, int chunkCount = 64);
+    ~StdinReader() override;
+    
+    // the next line without its line break, blocking until it's complete;
+    // returns false once the input is closed and all the lines were taken
+    bool nextLine(std::string& line);
+    
+private:
+    struct Chunk
+    {
+        std::vector<char> data;
+        int size { 0 };                 // 0 marks the end of the input
+    };
+    
+    void run() override;
+    bool takeChunk();
+    void releaseChunk();
+    
+    int fd_;
+    AbstractFifo fifo_;
+    std::vector<Chunk> chunks_;
+    WaitableEvent filled_;
+    WaitableEvent emptied_;
+    
+    // only used by the parser
+    const Chunk* current_ { nullptr };
+    int position_ { 0 };
+    bool ended_ { false };
+};
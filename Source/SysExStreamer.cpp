@@ -0,0 +1,158 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SysExStreamer.h"
+
+#include "ApplicationState.h"
+
+// the part of the file that's mapped at a time, it only grows for a message
+// that doesn't fit in it
+static const int64 WINDOW_SIZE = 1 << 20;
+
+SysExStreamer::SysExStreamer(ApplicationState& state)
+: state_(state), showProgress_(state.isScheduling())
+{
+}
+
+bool SysExStreamer::streamFile(const File& file)
+{
+    totalBytes_ = file.getSize();
+    auto position = int64(0);
+    auto windowSize = WINDOW_SIZE;
+    while (position < totalBytes_)
+    {
+        auto windowEnd = jmin(totalBytes_, position + windowSize);
+        MemoryMappedFile window(file, Range<int64>(position, windowEnd), MemoryMappedFile::readOnly);
+        if (window.getData() == nullptr)
+        {
+            return false;
+        }
+
+        // the mapping starts at a page boundary at or before the position
+        auto data = (const uint8*)window.getData() + (position - window.getRange().getStart());
+        auto atEnd = windowEnd == totalBytes_;
+        auto consumed = feed(data, (size_t)(windowEnd - position), atEnd);
+        if (consumed == 0 && !atEnd)
+        {
+            windowSize *= 2;
+        }
+        else
+        {
+            position += (int64)consumed;
+            windowSize = WINDOW_SIZE;
+        }
+    }
+    finish();
+    return true;
+}
+
+// sends the complete messages and returns how many bytes were consumed, a
+// message that runs past the end is left for the next window
+size_t SysExStreamer::feed(const uint8* data, size_t size, bool atEnd)
+{
+    auto end = data + size;
+    auto position = data;
+    while (position < end)
+    {
+        // anything in between the messages is skipped
+        auto begin = std::find(position, end, (uint8)0xf0);
+        if (begin == end)
+        {
+            break;
+        }
+
+        // the message ends at its F7, any other status byte means it was cut off
+        auto status = std::find_if(begin + 1, end, [](uint8 b) { return b >= 0x80; });
+        if (status == end)
+        {
+            if (atEnd)
+            {
+                ++incomplete_;
+                break;
+            }
+            return (size_t)(begin - data);
+        }
+        if (*status != 0xf7)
+        {
+            ++incomplete_;
+            position = status;
+            continue;
+        }
+
+        send(begin, (size_t)(status + 1 - begin));
+        position = status + 1;
+    }
+    return size;
+}
+
+void SysExStreamer::send(const uint8* data, size_t size)
+{
+    {
+        // the pacing counts as waiting for SysEx rather than for a timestamp
+        const ScopedValueSetter<bool> sysExWait(state_.waitingForSysEx_, true);
+        state_.waitForMicrosecondCounter(nextDue_);
+    }
+    state_.sendMidiMessage(MidiMessage(data, (int)size));
+    ++messageCount_;
+    bytesSent_ += (int64)size;
+
+    // the next message waits for the gap, or for this one to go through at
+    // the byte rate when that takes longer
+    auto wait = int64(state_.sysExGap_) * 1000;
+    auto rate = state_.getSysExRate();
+    if (rate > 0 && !state_.noWait_)
+    {
+        wait = jmax(wait, (int64)size * 1000000 / rate);
+    }
+    nextDue_ = jmax(nextDue_, state_.getMicrosecondCounter()) + wait;
+
+    printProgress();
+}
+
+void SysExStreamer::printProgress()
+{
+    if (!showProgress_ || totalBytes_ <= 0)
+    {
+        return;
+    }
+    auto percent = (int)(bytesSent_ * 100 / totalBytes_);
+    if (percent != lastPercent_)
+    {
+        // only count what went out of the port
+        state_.flushScheduledMessages();
+        std::cout << "\rSending SysEx " << percent << "% (" << bytesSent_ << " of " << totalBytes_ << " bytes)" << std::flush;
+        lastPercent_ = percent;
+    }
+}
+
+void SysExStreamer::finish()
+{
+    {
+        const ScopedValueSetter<bool> sysExWait(state_.waitingForSysEx_, true);
+        state_.waitForMicrosecondCounter(nextDue_);
+    }
+    if (showProgress_ && lastPercent_ >= 0)
+    {
+        state_.flushScheduledMessages();
+        std::cout << "\rSent " << messageCount_ << " SysEx messages (" << bytesSent_ << " bytes)          " << std::endl;
+    }
+    if (incomplete_ > 0)
+    {
+        std::cerr << "Skipped " << incomplete_ << " incomplete SysEx messages" << std::endl;
+    }
+}
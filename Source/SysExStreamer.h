@@ -0,0 +1,56 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+class ApplicationState;
+
+// Sends the SysEx messages of a .syx file one by one, with a gap in between
+// and no faster than a number of bytes per second. The file is memory mapped
+// a window at a time and each message is copied once from the mapped pages
+// into the message that's queued, while the scheduler holds back the ones
+// that follow until the bytes before them went out, so large firmware images
+// stream in a small, fixed amount of memory beyond their largest message.
+class SysExStreamer
+{
+public:
+    explicit SysExStreamer(ApplicationState& state);
+
+    // returns false when the file can't be mapped
+    bool streamFile(const File& file);
+
+    int getMessageCount() const { return messageCount_; }
+    int64 getBytesSent() const { return bytesSent_; }
+
+private:
+    size_t feed(const uint8* data, size_t size, bool atEnd);
+    void send(const uint8* data, size_t size);
+    void printProgress();
+    void finish();
+
+    ApplicationState& state_;
+    bool showProgress_;
+    int64 totalBytes_ { 0 };
+    int64 nextDue_ { 0 };           // in microseconds
+    int messageCount_ { 0 };
+    int64 bytesSent_ { 0 };
+    int incomplete_ { 0 };
+    int lastPercent_ { -1 };
+};
@@ -0,0 +1,211 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ValueParser.h"
+
+ValueParser::ValueParser(int octaveMiddleC, bool useHexadecimalsByDefault) :
+    octaveMiddleC_(octaveMiddleC),
+    useHexadecimalsByDefault_(useHexadecimalsByDefault)
+{
+}
+
+int ValueParser::intValue(const char* begin, const char* end) const
+{
+    auto suffix = begin < end ? CharacterFunctions::toUpperCase(end[-1]) : 0;
+    if (suffix == 'H')
+    {
+        return hexadecimalValue(begin, end);
+    }
+    else if (suffix == 'M')
+    {
+        return decimalValue(begin, end);
+    }
+    else if (useHexadecimalsByDefault_)
+    {
+        return hexadecimalValue(begin, end);
+    }
+    else
+    {
+        return decimalValue(begin, end);
+    }
+}
+
+uint8 ValueParser::noteNumber(const char* begin, const char* end) const
+{
+    if (end - begin >= 2 && CharacterFunctions::isDigit(end[-1]))
+    {
+        auto note = -1;
+        switch (CharacterFunctions::toUpperCase(begin[0]))
+        {
+            case 'C': note = 0; break;
+            case 'D': note = 2; break;
+            case 'E': note = 4; break;
+            case 'F': note = 5; break;
+            case 'G': note = 7; break;
+            case 'A': note = 9; break;
+            case 'B': note = 11; break;
+            case 'H': note = 11; break;
+        }
+        
+        if (note >= 0)
+        {
+            auto accidental = CharacterFunctions::toUpperCase(begin[1]);
+            if (accidental == 'B')
+            {
+                note -= 1;
+            }
+            else if (accidental == '#')
+            {
+                note += 1;
+            }
+            
+            note += (trailingIntValue(begin, end) + 5 - octaveMiddleC_) * 12;
+            
+            return (uint8)jlimit(0, 0x7f, note);
+        }
+    }
+    
+    return (uint8)jlimit(0, 0x7f, intValue(begin, end));
+}
+
+int ValueParser::decimalValue(const char* begin, const char* end)
+{
+    auto p = begin;
+    while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+    {
+        ++p;
+    }
+    auto negative = p < end && *p == '-';
+    if (negative)
+    {
+        ++p;
+    }
+    
+    uint32 value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p)
+    {
+        value = value * 10 + (uint32)(*p - '0');
+    }
+    return negative ? -(int)value : (int)value;
+}
+
+int ValueParser::hexadecimalValue(const char* begin, const char* end)
+{
+    uint32 value = 0;
+    for (auto p = begin; p < end; ++p)
+    {
+        auto digit = CharacterFunctions::getHexDigitValue((juce_wchar)(uint8)*p);
+        if (digit >= 0)
+        {
+            value = (value << 4) | (uint32)digit;
+        }
+    }
+    return (int)value;
+}
+
+int64_t ValueParser::timestamp(const char* begin, const char* end)
+{
+    const char* p = begin;
+    const auto length = (int)(end - begin);
+    
+    int64_t timestamp = 0;
+    if ((length == 12 || length == 15) && p[2] == ':' && p[5] == ':' && p[8] == '.')
+    {
+        auto hours = digitsValue(p, 2);
+        auto minutes = digitsValue(p + 3, 2);
+        auto seconds = digitsValue(p + 6, 2);
+        auto micros = fractionMicros(p + 9, length - 9);
+        if (hours >= 0 && minutes >= 0 && seconds >= 0 && micros >= 0)
+        {
+            auto now = Time();
+            timestamp = Time(now.getYear(), now.getMonth(), now.getDayOfMonth(),
+                             hours, minutes, seconds, 0).toMilliseconds() * 1000 + micros;
+        }
+    }
+    else if ((length == 13 || length == 16) && p[0] == '+' && p[3] == ':' && p[6] == ':' && p[9] == '.')
+    {
+        auto hours = digitsValue(p + 1, 2);
+        auto minutes = digitsValue(p + 4, 2);
+        auto seconds = digitsValue(p + 7, 2);
+        auto micros = fractionMicros(p + 10, length - 10);
+        if (hours >= 0 && minutes >= 0 && seconds >= 0 && micros >= 0)
+        {
+            timestamp = (((int64_t(hours) * 60 + int64_t(minutes)) * 60) + int64_t(seconds)) * 1000000 + micros;
+        }
+    }
+    else if ((length == 7 || length == 10) && p[0] == '+' && p[3] == '.')
+    {
+        auto seconds = digitsValue(p + 1, 2);
+        auto micros = fractionMicros(p + 4, length - 4);
+        if (seconds >= 0 && micros >= 0)
+        {
+            timestamp = int64_t(seconds) * 1000000 + micros;
+        }
+    }
+    return timestamp;
+}
+
+// the value of the digits at the end of the range, negative when they follow
+// a minus sign, like String::getTrailingIntValue
+int ValueParser::trailingIntValue(const char* begin, const char* end)
+{
+    int value = 0;
+    int multiplier = 1;
+    for (auto p = end; p > begin; --p)
+    {
+        auto c = p[-1];
+        if (!CharacterFunctions::isDigit(c))
+        {
+            if (c == '-')
+            {
+                value = -value;
+            }
+            break;
+        }
+        value += (int)(c - '0') * multiplier;
+        multiplier *= 10;
+    }
+    return value;
+}
+
+// the value of a run of decimal digits, or -1 when one of them isn't a digit
+int ValueParser::digitsValue(const char* text, int count)
+{
+    int value = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (text[i] < '0' || text[i] > '9')
+        {
+            return -1;
+        }
+        value = value * 10 + (text[i] - '0');
+    }
+    return value;
+}
+
+// the microseconds of a fraction of a second with three (milliseconds) or
+// six (microseconds) digits, or -1 when it isn't one
+int ValueParser::fractionMicros(const char* text, int count)
+{
+    auto value = digitsValue(text, count);
+    if (value < 0)
+    {
+        return -1;
+    }
+    return count == 3 ? value * 1000 : value;
+}
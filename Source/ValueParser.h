@@ -0,0 +1,61 @@
+/*
+ * This file is part of SendMIDI.
+ * Copyright (command) 2017-2024 Uwyn LLC.  https://www.uwyn.com
+ *
+ * SendMIDI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SendMIDI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// Reads the values of command options and timestamps straight out of a range
+// of characters, like a token inside a line, without terminating or copying
+// it. All the value forms are plain ASCII, so the characters are looked at
+// byte by byte.
+class ValueParser
+{
+public:
+    ValueParser(int octaveMiddleC, bool useHexadecimalsByDefault);
+    
+    // a number, decimal or hexadecimal according to the default, unless it
+    // ends in M for decimal or H for hexadecimal
+    int intValue(const char* begin, const char* end) const;
+    
+    // a note name like C3, Db-1 or F#4 with the octave of middle C, or else a
+    // number, limited to 7 bits
+    uint8 noteNumber(const char* begin, const char* end) const;
+    
+    // like String::getIntValue, the digits after optional whitespace and a
+    // minus sign, up to the first character that isn't one
+    static int decimalValue(const char* begin, const char* end);
+    
+    // like CharacterFunctions::HexParser, every hex digit of the range,
+    // skipping the characters that aren't
+    static int hexadecimalValue(const char* begin, const char* end);
+    
+    // the microseconds of a timestamp, with a fraction of three or six
+    // digits: for a time of day like HH:MM:SS.mmm, since the epoch at that
+    // local time on the date of Time(); for an offset like +SS.mmm or
+    // +HH:MM:SS.mmm, the offset; 0 when the range isn't a timestamp
+    static int64_t timestamp(const char* begin, const char* end);
+    
+private:
+    static int trailingIntValue(const char* begin, const char* end);
+    static int digitsValue(const char* text, int count);
+    static int fractionMicros(const char* text, int count);
+    
+    int octaveMiddleC_;
+    bool useHexadecimalsByDefault_;
+};
@@ -19,10 +19,15 @@
 #include "JuceHeader.h"
 
 #include "../Source/ApplicationState.h"
+#include "../Source/CommandServer.h"
+#include "../Source/HexDecoder.h"
+#include "../Source/LineTokenizer.h"
+#include "../Source/ValueParser.h"
 
 // Exercises the number and note-name parsing that turns command arguments into
 // MIDI values: note names against the middle-C octave, decimal/hexadecimal
-// selection, the M/H suffixes, and the 7/14-bit clamping.
+// selection, the M/H suffixes, and the 7/14-bit clamping, as well as the
+// lookup of command names and the splitting of lines into tokens.
 class ParsingTests : public UnitTest
 {
 public:
@@ -78,6 +83,105 @@ public:
             expectEquals((int)ApplicationState::limit14Bit(99999), 16383);
         }
 
+        beginTest("Commands are found by short and long name, ignoring case");
+        {
+            ApplicationState s;
+            expect(s.findApplicationCommand("cc")->command_ == CONTROL_CHANGE);
+            expect(s.findApplicationCommand("control-change")->command_ == CONTROL_CHANGE);
+            expect(s.findApplicationCommand("CC14")->command_ == CONTROL_CHANGE_14BIT);
+            expect(s.findApplicationCommand("Note-On")->command_ == NOTE_ON);
+            expect(s.findApplicationCommand("list")->command_ == LIST);
+            expect(s.findApplicationCommand("ccc") == nullptr);
+            expect(s.findApplicationCommand("64") == nullptr);
+            // commands without a long name don't match an empty token
+            expect(s.findApplicationCommand("") == nullptr);
+
+            // every name in the table resolves to its own command
+            for (auto&& cmd : s.getCommands())
+            {
+                expect(s.findApplicationCommand(cmd.param_)->command_ == cmd.command_);
+                if (cmd.altParam_.isNotEmpty())
+                {
+                    expect(s.findApplicationCommand(cmd.altParam_.toUpperCase())->command_ == cmd.command_);
+                }
+            }
+        }
+
+        beginTest("Lines tokenize in place exactly like the StringArray tokens did");
+        {
+            // the way lines were split before: addTokens keeping quoted strings,
+            // dropping whitespace-only tokens, then trimming the quotes
+            auto reference = [](const String& line)
+            {
+                StringArray parameters;
+                if (!line.startsWith("#"))
+                {
+                    StringArray tokens;
+                    tokens.addTokens(line, true);
+                    tokens.removeEmptyStrings(true);
+                    for (String token : tokens)
+                    {
+                        parameters.add(token.trimCharactersAtStart("\"").trimCharactersAtEnd("\""));
+                    }
+                }
+                return parameters;
+            };
+            auto tokenize = [](const String& line)
+            {
+                StringArray parameters;
+                std::string buffer(line.toRawUTF8());
+                LineTokenizer tokens(buffer.data());
+                while (auto token = tokens.next())
+                {
+                    parameters.add(String::fromUTF8(token));
+                }
+                return parameters;
+            };
+
+            StringArray lines {
+                "cc 74 55",
+                "  on\t60   100  \r",
+                "dev \"LinnStrument MIDI\" cc 20 5",
+                "dev \"unterminated quote cc 1 2",
+                "\"\" \" \" \"\"\"x\"\"\"",
+                "a\"b c\"d e",
+                "# a comment cc 1 2",
+                "  # not a comment when indented",
+                "",
+                "   ",
+            };
+            // non-ASCII text, a non-breaking space and a form feed stand alone
+            lines.add(String::fromUTF8("dev Caf\xc3\xa9 \xc2\xa0 \x0c on C#3 100"));
+            for (auto&& line : lines)
+            {
+                expect(tokenize(line) == reference(line), "tokens differ for: " + line);
+            }
+
+            // the tokens point into the line itself
+            char line[] = "on \"60\" 100";
+            LineTokenizer tokens(line);
+            expect(tokens.next() == line);
+            expect(tokens.next() == line + 4);
+            expect(String(tokens.next()) == "100");
+            expect(tokens.next() == nullptr);
+        }
+
+        beginTest("Command lines joined for a server split back into the same parameters");
+        {
+            StringArray parameters { "dev", "My Port (2)", "ch", "3", "on", "C3", "100", "syf", "a\tb.syx" };
+            auto line = CommandServer::joinParameters(parameters);
+            expectEquals(line, String("dev \"My Port (2)\" ch 3 on C3 100 syf \"a\tb.syx\""));
+
+            StringArray tokens;
+            std::string buffer(line.toRawUTF8());
+            LineTokenizer tokenizer(buffer.data());
+            while (auto token = tokenizer.next())
+            {
+                tokens.add(String::fromUTF8(token));
+            }
+            expect(tokens == parameters);
+        }
+
         beginTest("Ports that share a name get numbered and can be picked");
         {
             Array<MidiDeviceInfo> devices;
@@ -110,6 +214,187 @@ public:
             expectEquals(ApplicationState::matchDeviceIndex(devices, "LOOPMIDI"), 0);
             expectEquals(ApplicationState::matchDeviceIndex(devices, "nothing here"), -1);
         }
+
+        beginTest("The device registry keeps its ports and looks names up like the matching");
+        {
+            Array<MidiDeviceInfo> devices;
+            for (int i = 0; i < 200; ++i)
+            {
+                devices.add({"Virtual " + String(i % 100), "id" + String(i)});
+            }
+
+            DeviceRegistry registry(DeviceRegistry::OUTPUTS);
+            registry.setDevices(devices);
+            expectEquals(registry.getDevices().size(), 200);
+            expectEquals(registry.getDisplayNames()[150], String("Virtual 50 (2)"));
+            expectEquals(registry.find("Virtual 50 (2)"), 150);
+            expectEquals(registry.find("virtual 99"), 99);
+            expectEquals(registry.findByName("Virtual 7"), 7);
+            expectEquals(registry.findByName("Virtual 7 (2)"), -1);
+            expectEquals(registry.find("nothing here"), -1);
+            expectEquals(registry.findDevice("Virtual 50 (2)")->identifier, String("id150"));
+            expect(!registry.findDevice("nothing here").has_value());
+
+            // every name resolves to the port the plain matching picks
+            for (auto&& name : registry.getDisplayNames())
+            {
+                expectEquals(registry.find(name), ApplicationState::matchDeviceIndex(devices, name));
+            }
+        }
+
+        beginTest("Timestamps are read in microseconds, with a millisecond or microsecond fraction");
+        {
+            expectEquals(ApplicationState::parseTimestamp("+01.060"), (int64_t)1060000);
+            expectEquals(ApplicationState::parseTimestamp("+01.060250"), (int64_t)1060250);
+            expectEquals(ApplicationState::parseTimestamp("+00:01:02.003"), (int64_t)62003000);
+            expectEquals(ApplicationState::parseTimestamp("+00:01:02.000004"), (int64_t)62000004);
+
+            // a time of day keeps its fraction to the microsecond
+            auto millis = ApplicationState::parseTimestamp("08:10:17.056");
+            auto micros = ApplicationState::parseTimestamp("08:10:17.056007");
+            expectEquals(micros - millis, (int64_t)7);
+            expectEquals(millis % 1000000, (int64_t)56000);
+
+            // and counts from the epoch, at that local time of today
+            auto now = Time();
+            auto expected = Time(now.getYear(), now.getMonth(), now.getDayOfMonth(), 8, 10, 17, 56);
+            expectEquals(millis, (int64_t)expected.toMilliseconds() * 1000);
+
+            // other fraction lengths and stray characters aren't timestamps
+            expectEquals(ApplicationState::parseTimestamp("+01.06"), (int64_t)0);
+            expectEquals(ApplicationState::parseTimestamp("+01.0602"), (int64_t)0);
+            expectEquals(ApplicationState::parseTimestamp("+01.06x250"), (int64_t)0);
+            expectEquals(ApplicationState::parseTimestamp("on"), (int64_t)0);
+        }
+
+        beginTest("Values are read out of a line without terminating the tokens");
+        {
+            const char* line = "on C#3 100 7FH 10M +01.060 08:10:17.056 +00:01:02.000004";
+            auto at = [&](int start, int length) { return std::make_pair(line + start, line + start + length); };
+
+            ValueParser values(3, false);
+            auto note = at(3, 3);
+            expectEquals((int)values.noteNumber(note.first, note.second), 61);
+            auto velocity = at(7, 3);
+            expectEquals(values.intValue(velocity.first, velocity.second), 100);
+            auto hex = at(11, 3);
+            expectEquals(values.intValue(hex.first, hex.second), 0x7f);
+            auto decimal = at(15, 3);
+            expectEquals(ValueParser(3, true).intValue(decimal.first, decimal.second), 10);
+            // without the M the same digits are hexadecimal
+            expectEquals(ValueParser(3, true).intValue(decimal.first, decimal.second - 1), 0x10);
+
+            auto relative = at(19, 7);
+            expectEquals(ValueParser::timestamp(relative.first, relative.second), (int64_t)1060000);
+            auto timeOfDay = at(27, 12);
+            expectEquals(ValueParser::timestamp(timeOfDay.first, timeOfDay.second),
+                         ApplicationState::parseTimestamp("08:10:17.056"));
+            auto longOffset = at(40, 16);
+            expectEquals(ValueParser::timestamp(longOffset.first, longOffset.second), (int64_t)62000004);
+            // a range that stops short isn't a timestamp
+            expectEquals(ValueParser::timestamp(relative.first, relative.second - 1), (int64_t)0);
+
+            // an empty range is 0
+            expectEquals(values.intValue(line, line), 0);
+            expectEquals((int)values.noteNumber(line, line), 0);
+        }
+
+        beginTest("The value parser reads what the String functions read");
+        {
+            // the way values were read before, with String copies
+            auto referenceInt = [](String value, bool hexByDefault)
+            {
+                auto upper = value.toUpperCase();
+                if (upper.endsWith("H"))
+                {
+                    return value.dropLastCharacters(1).getHexValue32();
+                }
+                else if (upper.endsWith("M"))
+                {
+                    return value.dropLastCharacters(1).getIntValue();
+                }
+                return hexByDefault ? value.getHexValue32() : value.getIntValue();
+            };
+            auto referenceNote = [&](String value, int octaveMiddleC, bool hexByDefault)
+            {
+                auto upper = value.toUpperCase();
+                if (upper.length() >= 2 && String("CDEFGABH").containsChar(upper[0]) &&
+                    CharacterFunctions::isDigit(upper.getLastCharacter()))
+                {
+                    auto note = String("C D EF G A BB").indexOfChar(upper[0] == 'H' ? 'B' : upper[0]);
+                    note += upper[1] == 'B' ? -1 : upper[1] == '#' ? 1 : 0;
+                    note += (upper.getTrailingIntValue() + 5 - octaveMiddleC) * 12;
+                    return jlimit(0, 127, note);
+                }
+                return jlimit(0, 127, referenceInt(value, hexByDefault));
+            };
+
+            StringArray tokens { "0", "60", "127", "200", "-5", "7f", "7F", "7fH", "64h", "100M", "10m",
+                                 "1F4H", "C3", "c3", "C-2", "G8", "C#3", "Db3", "db-1", "Bb3", "H4",
+                                 "B#9", "Cb-2", "E", "A0x", "x1", "-", "H", "M", "12-3", "ff", "g5" };
+            for (auto octaveMiddleC : { 3, 4, -1 })
+            {
+                for (auto hexByDefault : { false, true })
+                {
+                    ValueParser values(octaveMiddleC, hexByDefault);
+                    for (auto&& token : tokens)
+                    {
+                        auto text = token.toRawUTF8();
+                        auto end = text + token.getNumBytesAsUTF8();
+                        expectEquals(values.intValue(text, end), referenceInt(token, hexByDefault),
+                                     "value of " + token);
+                        expectEquals((int)values.noteNumber(text, end), referenceNote(token, octaveMiddleC, hexByDefault),
+                                     "note of " + token);
+                    }
+                }
+            }
+        }
+
+        beginTest("Hex blobs decode the same with SIMD as one pair at a time");
+        {
+            Random random(23);
+            const char* digits = "0123456789abcdefABCDEF";
+            for (int round = 0; round < 300; ++round)
+            {
+                // lengths around the 32 and 64 digit blocks, and an odd one now and then
+                auto length = (size_t)random.nextInt(300);
+                auto sevenBit = random.nextBool();
+                std::string hex;
+                for (size_t i = 0; i < length; ++i)
+                {
+                    hex += digits[random.nextInt(sevenBit && i % 2 == 0 ? 8 : 22)];
+                }
+                // every other round has a problem somewhere
+                if (length > 0 && round % 2 == 1)
+                {
+                    auto at = (size_t)random.nextInt((int)length);
+                    hex[at] = sevenBit && at % 2 == 0 && random.nextBool() ? '9' : "g x@"[random.nextInt(4)];
+                }
+
+                std::vector<uint8> simd(length / 2, 0), scalar(length / 2, 0);
+                auto simdDone = HexDecoder::decode(hex.data(), length, simd.data(), sevenBit);
+                auto scalarDone = HexDecoder::decodeScalar(hex.data(), length, scalar.data(), sevenBit);
+                expectEquals((int)simdDone, (int)scalarDone, "position differs for: " + String(hex));
+                expect(std::equal(simd.begin(), simd.begin() + (long)(simdDone / 2), scalar.begin()),
+                       "bytes differ for: " + String(hex));
+            }
+
+            // the position is that of the pair at fault
+            uint8 out[64];
+            expectEquals((int)HexDecoder::decodeScalar("00fF7e", 6, out, false), 6);
+            expectEquals((int)out[1], 0xff);
+            expectEquals((int)HexDecoder::decodeScalar("00fF7e", 6, out, true), 2);
+            expectEquals((int)HexDecoder::decodeScalar("0011g2", 6, out, false), 4);
+            expectEquals((int)HexDecoder::decodeScalar("00112", 5, out, false), 4);
+            std::string block(128, '1');
+            block[77] = '-';
+            expectEquals((int)HexDecoder::decode(block.data(), block.size(), out, true), 76);
+            block[77] = '1';
+            block[100] = 'C';
+            expectEquals((int)HexDecoder::decode(block.data(), block.size(), out, true), 100);
+            expectEquals((int)HexDecoder::decode(block.data(), block.size(), out, false), 128);
+            expectEquals((int)out[50], 0xc1);
+        }
     }
 };
 
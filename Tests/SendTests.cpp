@@ -19,6 +19,44 @@
 #include "JuceHeader.h"
 
 #include "../Source/ApplicationState.h"
+#include "../Source/CommandServer.h"
+#include "../Source/CompiledProgram.h"
+#include "../Source/FanOutPort.h"
+#include "../Source/MidiClock.h"
+#include "../Source/MidiPort.h"
+#include "../Source/MidiScheduler.h"
+#include "../Source/SendStats.h"
+#include "../Source/StdinReader.h"
+
+#if ! JUCE_WINDOWS
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+// counts what's allocated through operator new on the threads that ask for
+// it, for the test that channel voice commands are sent without allocating
+static thread_local bool countingAllocations = false;
+static thread_local int64 allocationsCounted = 0;
+
+static void* countedAllocation(std::size_t size)
+{
+    if (countingAllocations)
+    {
+        allocationsCounted += 1;
+    }
+    if (auto* p = std::malloc(size > 0 ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return countedAllocation(size); }
+void* operator new[](std::size_t size) { return countedAllocation(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
 
 // Exercises the messages each command produces, by parsing a real command line
 // and collecting the MIDI it would send (no device opened). The expected bytes
@@ -182,11 +220,79 @@ public:
             expect(rawHex[0].isNoteOn());
             expectEquals(rawHex[0].getNoteNumber(), 0x3C);
             expectEquals((int)rawHex[0].getVelocity(), 0x64);
+
+            // a long SysEx keeps every byte, limited to 7 bits, and its framing
+            String line("syx");
+            for (int i = 0; i < 32768; ++i)
+            {
+                line << " " << (i % 200);
+            }
+            auto longSyx = ApplicationState().collectLine(line);
+            expectEquals(longSyx.size(), 1);
+            expectEquals(longSyx[0].getRawDataSize(), 32770);
+            expectEquals((int)longSyx[0].getRawData()[0], 0xf0);
+            expectEquals((int)longSyx[0].getRawData()[32769], 0xf7);
+            auto intact = true;
+            for (int i = 0; i < 32768; ++i)
+            {
+                intact = intact && longSyx[0].getSysExData()[i] == jmin(i % 200, 127);
+            }
+            expect(intact);
+        }
+
+        beginTest("Hex blobs carry the same bytes as separate values");
+        {
+            auto sameBytes = [](const MidiMessage& a, const MidiMessage& b)
+            {
+                return a.getRawDataSize() == b.getRawDataSize() &&
+                       std::memcmp(a.getRawData(), b.getRawData(), (size_t)a.getRawDataSize()) == 0;
+            };
+            auto syx = ApplicationState().collectLine("syx @01027F");
+            expectEquals(syx.size(), 1);
+            expect(sameBytes(syx[0], ApplicationState().collectLine("syx 1 2 127")[0]));
+
+            // the delimiters may be included, blobs and values mix
+            auto framed = ApplicationState().collectLine("syx @F043105e 16 @10F7");
+            expectEquals(framed.size(), 1);
+            expect(sameBytes(framed[0], ApplicationState().collectLine("hex syx 43 10 5E 10 10")[0]));
+
+            auto raw = ApplicationState().collectLine("raw @903c64");
+            expect(raw[0].isNoteOn());
+            expectEquals(raw[0].getNoteNumber(), 0x3c);
+            expectEquals((int)raw[0].getVelocity(), 0x64);
+
+            // a blob the size of a patch bank
+            String line("syx @");
+            for (int i = 0; i < 32768; ++i)
+            {
+                line << String::toHexString(i % 128).paddedLeft('0', 2);
+            }
+            auto big = ApplicationState().collectLine(line);
+            expectEquals(big.size(), 1);
+            expectEquals(big[0].getSysExDataSize(), 32768);
+            auto intact = true;
+            for (int i = 0; i < 32768; ++i)
+            {
+                intact = intact && big[0].getSysExData()[i] == i % 128;
+            }
+            expect(intact);
         }
 
-        beginTest("Panic sends pedal/all-off, resets and every note off on all channels");
+        beginTest("Hex blobs with a problem are skipped");
         {
-            auto m = ApplicationState().collectLine("panic");
+            // a SysEx byte needs to be 7-bit, digits come in pairs
+            expectEquals(ApplicationState().collectLine("syx @0180").size(), 0);
+            expectEquals(ApplicationState().collectLine("syx @010").size(), 0);
+            expectEquals(ApplicationState().collectLine("raw @90xx64").size(), 0);
+            // the rest of the command still goes through
+            auto m = ApplicationState().collectLine("syx 1 @zz 2");
+            expectEquals(m.size(), 1);
+            expectEquals(m[0].getSysExDataSize(), 2);
+        }
+
+        beginTest("Full panic sends pedal/all-off, resets and every note off on all channels");
+        {
+            auto m = ApplicationState().collectLine("panic full");
             // per channel: sustain off, all-sound-off, reset-all-controllers,
             // all-notes-off, pitch bend recenter, 128 note offs
             expectEquals(m.size(), 16 * (5 + 128));
@@ -200,6 +306,42 @@ public:
             expectEquals(m[m.size() - 1].getChannel(), 16);
         }
 
+        beginTest("Panic sends all notes off first and note offs only for the notes that are on");
+        {
+            ApplicationState s;
+            auto m = s.collectLine("on 60 100 on 62 100 off 62 0 ch 3 on 64 100 on 65 0 panic");
+            // 5 note messages, then per channel: all notes off, all sound off,
+            // sustain off, reset all controllers, pitch bend, and the offs for 60 and 64
+            expectEquals(m.size(), 5 + 16 * 5 + 2);
+            expectEquals(m[5].getControllerNumber(), 123);
+            expectEquals(m[6].getControllerNumber(), 120);
+            expect(m[10].isNoteOff());
+            expectEquals(m[10].getChannel(), 1);
+            expectEquals(m[10].getNoteNumber(), 60);
+            expect(m[5 + 6 + 5 + 5].isNoteOff());
+            expectEquals(m[5 + 6 + 5 + 5].getChannel(), 3);
+            expectEquals(m[5 + 6 + 5 + 5].getNoteNumber(), 64);
+            expect(s.getNotesOn(1).none() && s.getNotesOn(3).none());
+
+            // the panic turned everything off, so another one has no notes to send
+            expectEquals(s.collectLine("panic").size(), 16 * 5);
+        }
+
+        beginTest("Panic only takes the word full, whatever else follows is parsed as usual");
+        {
+            TemporaryFile program(".txt");
+            program.getFile().replaceWithText("cc 74 1\n");
+
+            auto m = ApplicationState().collect({"panic", program.getFile().getFullPathName()});
+            expectEquals(m.size(), 16 * 5 + 1);
+            expect(m[m.size() - 1].isController());
+            expectEquals(m[m.size() - 1].getControllerNumber(), 74);
+
+            expectEquals(ApplicationState().collect({"panic", "FULL"}).size(), 16 * (5 + 128));
+            // a full panic takes the word right after it only
+            expectEquals(ApplicationState().collectLine("panic cc 1 2 full").size(), 16 * 5 + 1);
+        }
+
         beginTest("Out-of-range channel is rejected and leaves the channel unchanged");
         {
             // channel 0 and >16 are invalid, so the note still sends on the default channel 1
@@ -242,6 +384,246 @@ public:
             expectEquals(none.size(), 0);
         }
 
+        beginTest("Clock ticks are timed from the first one, ramping evenly to the end BPM");
+        {
+            MidiClock steady(120.0, 120.0, 1000);
+            for (int i = 0; i < 24000; ++i)
+            {
+                steady.advance();
+            }
+            // 1000 beats at 120 BPM take exactly 500 seconds, to the microsecond
+            expect(!steady.isRunning());
+            expectWithinAbsoluteError(steady.getNextTickOffset(), 500000000.0, 1.0);
+
+            // the intervals shrink from 120 to 240 BPM over the ticks
+            MidiClock ramp(120.0, 240.0, 1);
+            double previous = 0.0, first = 0.0, last = 0.0;
+            for (int i = 0; i < 23; ++i)
+            {
+                ramp.advance();
+                auto interval = ramp.getNextTickOffset() - previous;
+                previous = ramp.getNextTickOffset();
+                first = i == 0 ? interval : first;
+                last = interval;
+            }
+            expectWithinAbsoluteError(first, 60000000.0 / 120.0 / 24.0, 0.001);
+            expectWithinAbsoluteError(last, 60000000.0 / 240.0 / 24.0, 0.001);
+
+            auto collected = ApplicationState().collectLine("clock 999 1 500");
+            expectEquals(collected.size(), 24);
+        }
+
+        beginTest("The scheduled clock runs alongside other messages and lines up Start with a tick");
+        {
+            Array<MidiMessage> sent;
+            {
+                MidiScheduler scheduler([&](const MidiBuffer& messages)
+                {
+                    for (const auto metadata : messages)
+                    {
+                        sent.add(metadata.getMessage());
+                    }
+                });
+                auto now = Time::getHighResolutionTicks();
+                scheduler.scheduleClock(600.0, 600.0, 1, now);
+                // half way in between two ticks of 4.17 ms
+                scheduler.schedule(MidiMessage::midiStart(), now + Time::secondsToHighResolutionTicks(0.0062));
+                scheduler.schedule(MidiMessage::controllerEvent(1, 74, 1), now + Time::secondsToHighResolutionTicks(0.0063));
+                scheduler.finish();
+                expectEquals(scheduler.getClockStats().getCount(), 23);
+                expectWithinAbsoluteError(scheduler.getClockStats().getMeanIntervalMicros(), 60000000.0 / 600.0 / 24.0, 500.0);
+            }
+
+            expectEquals(sent.size(), 26);
+            int ticks = 0;
+            for (int i = 0; i < sent.size(); ++i)
+            {
+                ticks += sent[i].isMidiClock() ? 1 : 0;
+                if (sent[i].isMidiStart())
+                {
+                    // held back until the third tick, sent right before it
+                    expectEquals(ticks, 2);
+                    expect(sent[i + 1].isMidiClock());
+                }
+                if (sent[i].isController())
+                {
+                    // other messages don't wait for the clock
+                    expectEquals(ticks, 2);
+                }
+            }
+            expectEquals(ticks, 24);
+        }
+
+        beginTest("Stop ends a clock that runs until stopped");
+        {
+            Array<MidiMessage> sent;
+            {
+                MidiScheduler scheduler([&](const MidiBuffer& messages)
+                {
+                    for (const auto metadata : messages)
+                    {
+                        sent.add(metadata.getMessage());
+                    }
+                });
+                auto now = Time::getHighResolutionTicks();
+                scheduler.scheduleClock(600.0, 600.0, 0, now);
+                scheduler.schedule(MidiMessage::midiContinue(), now + Time::secondsToHighResolutionTicks(0.0062));
+                scheduler.schedule(MidiMessage::midiStop(), now + Time::secondsToHighResolutionTicks(0.0063));
+                // the Stop went out with the queue, so the clock ended with it
+                scheduler.flush();
+                scheduler.finish();
+            }
+            Thread::sleep(20);
+
+            // the Continue still held for the third tick goes out before the Stop
+            expectEquals(sent.size(), 4);
+            expect(sent[0].isMidiClock());
+            expect(sent[1].isMidiClock());
+            expect(sent[2].isMidiContinue());
+            expect(sent[3].isMidiStop());
+        }
+
+        beginTest("The clock runs on a port that also sends messages on their own");
+        {
+            std::atomic<int> ticks { 0 };
+            std::atomic<int> single { 0 };
+            {
+                MidiScheduler scheduler([&](const MidiBuffer& messages)
+                {
+                    for (const auto metadata : messages)
+                    {
+                        ticks += metadata.getMessage().isMidiClock() ? 1 : 0;
+                    }
+                }, nullptr, [&](const MidiMessage&) { single += 1; });
+                scheduler.scheduleClock(600.0, 600.0, 1, Time::getHighResolutionTicks());
+                scheduler.finish();
+            }
+
+            // the clock event isn't taken for a message of its own
+            expectEquals(ticks.load(), 24);
+            expectEquals(single.load(), 0);
+        }
+
+        beginTest("SysEx and large messages go out on their own and hold back the ones after them");
+        {
+            std::vector<uint8> data((size_t)MidiScheduler::MAXIMUM_QUEUED_BYTES * 3 / 4, 0x11);
+            data.front() = 0xf0;
+            data.back() = 0xf7;
+
+            std::atomic<int> blocks { 0 };
+            std::atomic<int> large { 0 };
+            std::atomic<int> small { 0 };
+            {
+                MidiScheduler scheduler([&](const MidiBuffer&) { blocks += 1; }, nullptr, [&](const MidiMessage& msg)
+                {
+                    if (msg.getRawDataSize() < MidiScheduler::LARGE_MESSAGE_SIZE)
+                    {
+                        small += 1;
+                        return;
+                    }
+                    expectEquals(msg.getRawDataSize(), (int)data.size());
+                    Thread::sleep(30);
+                    large += 1;
+                });
+                auto now = Time::getHighResolutionTicks();
+                scheduler.schedule(MidiMessage::controllerEvent(1, 74, 1), now);
+                // a short SysEx isn't copied into a block either
+                const uint8 sysEx[] = { 0x43, 0x10, 0x4c };
+                scheduler.schedule(MidiMessage::createSysExMessage(sysEx, 3), now);
+                scheduler.schedule(MidiMessage(data.data(), (int)data.size()), now);
+
+                // the second one doesn't fit in the queue next to the first
+                auto start = Time::getMillisecondCounter();
+                scheduler.schedule(MidiMessage(data.data(), (int)data.size()), now);
+                expect(Time::getMillisecondCounter() - start >= 20);
+                expect(large.load() >= 1);
+                scheduler.flush();
+                expectEquals(scheduler.getSentCount(), 4);
+            }
+            expectEquals(blocks.load(), 1);
+            expectEquals(small.load(), 1);
+            expectEquals(large.load(), 2);
+        }
+
+        beginTest("Flushing the queue doesn't wait for a running clock");
+        {
+            std::atomic<int> ticks { 0 };
+            std::atomic<int> controllers { 0 };
+            {
+                MidiScheduler scheduler([&](const MidiBuffer& messages)
+                {
+                    for (const auto metadata : messages)
+                    {
+                        ticks += metadata.getMessage().isMidiClock() ? 1 : 0;
+                        controllers += metadata.getMessage().isController() ? 1 : 0;
+                    }
+                });
+                auto now = Time::getHighResolutionTicks();
+                scheduler.scheduleClock(600.0, 600.0, 0, now);
+                scheduler.schedule(MidiMessage::controllerEvent(1, 74, 1), now + Time::secondsToHighResolutionTicks(0.0063));
+                auto start = Time::getMillisecondCounter();
+                scheduler.flush();
+                expect(Time::getMillisecondCounter() - start < 1000);
+                expectEquals(controllers.load(), 1);
+
+                // the clock carries on after the flush, until a Stop
+                auto before = ticks.load();
+                Thread::sleep(20);
+                expect(ticks.load() > before);
+                scheduler.schedule(MidiMessage::midiStop(), Time::getHighResolutionTicks());
+                scheduler.finish();
+            }
+        }
+
+        beginTest("A Song Position Pointer goes out with the Continue after it, before a tick");
+        {
+            Array<MidiMessage> sent;
+            {
+                MidiScheduler scheduler([&](const MidiBuffer& messages)
+                {
+                    for (const auto metadata : messages)
+                    {
+                        sent.add(metadata.getMessage());
+                    }
+                });
+                auto now = Time::getHighResolutionTicks();
+                scheduler.scheduleClock(600.0, 600.0, 1, now);
+                scheduler.schedule(MidiMessage::songPositionPointer(16), now + Time::secondsToHighResolutionTicks(0.0062));
+                scheduler.schedule(MidiMessage::controllerEvent(1, 74, 1), now + Time::secondsToHighResolutionTicks(0.0063));
+                // the Continue comes after the next tick, the position waits for it
+                scheduler.schedule(MidiMessage::midiContinue(), now + Time::secondsToHighResolutionTicks(0.0100));
+                // without a Continue after it, a position goes out when the clock ends
+                scheduler.schedule(MidiMessage::songPositionPointer(32), now + Time::secondsToHighResolutionTicks(0.0150));
+                scheduler.finish();
+            }
+
+            expectEquals(sent.size(), 24 + 4);
+            int ticks = 0;
+            int positions = 0;
+            for (int i = 0; i < sent.size(); ++i)
+            {
+                ticks += sent[i].isMidiClock() ? 1 : 0;
+                if (sent[i].isController())
+                {
+                    expectEquals(ticks, 2);
+                }
+                if (sent[i].isSongPositionPointer() && sent[i].getSongPositionPointerMidiBeat() == 16)
+                {
+                    // held past the third tick until the Continue, then right before the fourth
+                    expectEquals(ticks, 3);
+                    expect(sent[i + 1].isMidiContinue());
+                    expect(sent[i + 2].isMidiClock());
+                    positions += 1;
+                }
+                if (sent[i].isSongPositionPointer() && sent[i].getSongPositionPointerMidiBeat() == 32)
+                {
+                    expectEquals(ticks, 24);
+                    positions += 1;
+                }
+            }
+            expectEquals(positions, 2);
+        }
+
         beginTest("Variable-argument commands without arguments send nothing");
         {
             // syx and raw execute with whatever bytes were provided; with none
@@ -261,6 +643,526 @@ public:
             expect(m[1].isNoteOn());
         }
 
+        beginTest("Program files run line by line, with commands spanning lines");
+        {
+            TemporaryFile program(".txt");
+            // a byte order mark, CR LF and lone CR line endings, a comment, and a
+            // syx whose bytes carry on over the next lines
+            const char text[] = "\xef\xbb\xbf" "ch 2\r\n"
+                                "# on 1 1\r\n"
+                                "on 60 100\r"
+                                "syx 1 2\n"
+                                "3\n"
+                                "\n"
+                                "4 cc 74 55\n"
+                                "off 60 0";
+            program.getFile().replaceWithData(text, sizeof(text) - 1);
+
+            auto m = ApplicationState().collect({"file", program.getFile().getFullPathName()});
+            expectEquals(m.size(), 4);
+            expect(m[0].isNoteOn());
+            expectEquals(m[0].getChannel(), 2);
+            expect(m[1].isSysEx());
+            expectEquals(m[1].getSysExDataSize(), 4);
+            expectEquals((int)m[1].getSysExData()[3], 4);
+            expect(m[2].isController());
+            expect(m[3].isNoteOff());
+        }
+
+        beginTest("Program files larger than the read chunk lose no lines");
+        {
+            // enough lines to cross several chunk boundaries, with CR LF endings
+            // so that some of them straddle a boundary
+            TemporaryFile program(".txt");
+            MemoryOutputStream text;
+            for (int i = 0; i < 20000; ++i)
+            {
+                text << "cc " << (i % 128) << " " << ((i / 128) % 128) << "\r\n";
+            }
+            program.getFile().replaceWithData(text.getData(), text.getDataSize());
+
+            auto m = ApplicationState().collect({"file", program.getFile().getFullPathName()});
+            expectEquals(m.size(), 20000);
+            expectEquals(m[19999].getControllerNumber(), 19999 % 128);
+            expectEquals(m[19999].getControllerValue(), (19999 / 128) % 128);
+        }
+
+        beginTest("SysEx files are mapped and sent message by message, at the configured rate");
+        {
+            // junk, a short message, one that's larger than a mapped window,
+            // a cut off one, and another short one
+            MemoryOutputStream bytes;
+            bytes << "junk";
+            for (auto b : { 0xf0, 0x7d, 0x01, 0xf7, 0xf0 })
+            {
+                bytes.writeByte((char)b);
+            }
+            const int large = 1500000;
+            for (int i = 0; i < large; ++i)
+            {
+                bytes.writeByte((char)(i & 0x7f));
+            }
+            bytes.writeByte((char)0xf7);
+            for (auto b : { 0xf0, 0x01, 0x02, 0xf0, 0x7d, 0x03, 0xf7 })
+            {
+                bytes.writeByte((char)b);
+            }
+            TemporaryFile syx(".syx");
+            syx.getFile().replaceWithData(bytes.getData(), bytes.getDataSize());
+
+            auto m = ApplicationState().collect({"syr", "0", "syf", syx.getFile().getFullPathName()});
+            expectEquals(m.size(), 3);
+            expect(m[0].isSysEx());
+            expectEquals(m[0].getSysExDataSize(), 2);
+            expectEquals(m[1].getSysExDataSize(), large);
+            expectEquals((int)m[1].getSysExData()[large - 1], (large - 1) & 0x7f);
+            expectEquals(m[2].getSysExDataSize(), 2);
+            expectEquals((int)m[2].getSysExData()[0], 0x7d);
+
+            // three messages of ten bytes at 1000 bytes per second take 30 ms,
+            // with a gap in between that's shorter than that
+            TemporaryFile small(".syx");
+            MemoryOutputStream three;
+            for (int i = 0; i < 3; ++i)
+            {
+                for (auto b : { 0xf0, 0x7d, 1, 2, 3, 4, 5, 6, 7, 0xf7 })
+                {
+                    three.writeByte((char)b);
+                }
+            }
+            small.getFile().replaceWithData(three.getData(), three.getDataSize());
+            auto start = Time::getMillisecondCounter();
+            m = ApplicationState().collect({"syg", "5", "sysex-rate", "1000", "syf", small.getFile().getFullPathName()});
+            expect(Time::getMillisecondCounter() - start >= 30);
+            expectEquals(m.size(), 3);
+        }
+
+        beginTest("Compiled programs play back the MIDI of their program file");
+        {
+            TemporaryFile program(".txt");
+            program.getFile().replaceWithText("ch 3 on 60 100\n"
+                                              "+00.020 cc 74 55\n"
+                                              "syx 1 2 3\n"
+                                              "+00.020 off 60 0 raw 248\n");
+            TemporaryFile compiled(".smc");
+
+            ApplicationState compiler;
+            expect(compiler.collect({"compile", program.getFile().getFullPathName(),
+                                     compiled.getFile().getFullPathName()}).isEmpty());
+
+            auto expected = ApplicationState().collect({"file", program.getFile().getFullPathName()});
+            auto start = Time::getMillisecondCounter();
+            auto m = ApplicationState().collect({"play", compiled.getFile().getFullPathName()});
+            // the delays of the program are part of the compiled file
+            expect(Time::getMillisecondCounter() - start >= 40);
+
+            expectEquals(m.size(), expected.size());
+            for (int i = 0; i < jmin(m.size(), expected.size()); ++i)
+            {
+                expectEquals(m[i].getRawDataSize(), expected[i].getRawDataSize());
+                expect(memcmp(m[i].getRawData(), expected[i].getRawData(), (size_t)m[i].getRawDataSize()) == 0);
+            }
+
+            expectEquals(CompiledProgram::countMessages(compiled.getFile()), (int64)expected.size());
+
+            // anything else isn't played
+            expect(ApplicationState().collect({"play", program.getFile().getFullPathName()}).isEmpty());
+            expectEquals(CompiledProgram::countMessages(program.getFile()), (int64)-1);
+        }
+
+        beginTest("Anchored relative timestamps are timed from when the previous one was due");
+        {
+            ApplicationState anchored;
+            anchored.collectLine("anchor");
+            auto due = anchored.getLastTimeStampCounter();
+            expectEquals(anchored.collectLine("+00.005 cc 74 1").size(), 1);
+            expectEquals(anchored.getLastTimeStampCounter() - due, (int64)5000);
+
+            // a slow stretch in between doesn't move the next one on, it's
+            // due right away and the offsets keep adding up exactly
+            Thread::sleep(30);
+            expectEquals(anchored.collectLine("+00.005 cc 74 2").size(), 1);
+            expectEquals(anchored.getLastTimeStampCounter() - due, (int64)10000);
+            anchored.collectLine("+00.002500");
+            expectEquals(anchored.getLastTimeStampCounter() - due, (int64)12500);
+
+            // without anchor, each offset counts from when the wait before it ended
+            ApplicationState relative;
+            relative.collectLine("+00.005");
+            auto ended = relative.getLastTimeStampCounter();
+            Thread::sleep(30);
+            relative.collectLine("+00.005");
+            expect(relative.getLastTimeStampCounter() - ended >= 35000);
+        }
+
+        beginTest("The scheduler sends messages in order, not before their deadline");
+        {
+            Array<MidiMessage> sent;
+            Array<int64> sentAt;
+            int blocks = 0;
+            auto now = Time::getHighResolutionTicks();
+            auto ms = Time::secondsToHighResolutionTicks(0.001);
+            {
+                MidiScheduler scheduler([&](const MidiBuffer& messages)
+                {
+                    ++blocks;
+                    for (const auto metadata : messages)
+                    {
+                        sent.add(metadata.getMessage());
+                        sentAt.add(Time::getHighResolutionTicks());
+                    }
+                });
+                for (int i = 0; i < 5; ++i)
+                {
+                    scheduler.schedule(MidiMessage::controllerEvent(1, 74, i), now + i * 10 * ms);
+                }
+                // more than the queue holds, all due right away
+                for (int i = 0; i < 2000; ++i)
+                {
+                    scheduler.schedule(MidiMessage::controllerEvent(1, 75, i % 128), now);
+                }
+                scheduler.flush();
+                expectEquals(scheduler.getSentCount(), 2005);
+            }
+
+            expectEquals(sent.size(), 2005);
+            for (int i = 0; i < 5; ++i)
+            {
+                expectEquals(sent[i].getControllerValue(), i);
+                expect(sentAt[i] >= now + i * 10 * ms);
+            }
+            expectEquals(sent[2004].getControllerValue(), 1999 % 128);
+            // the messages that are due together go out in blocks
+            expect(blocks < sent.size() / 2);
+        }
+
+        beginTest("Running status leaves out repeated channel status bytes until a reset");
+        {
+            RunningStatusEncoder encoder;
+            std::vector<uint8> bytes;
+            auto encode = [&](const MidiMessage& msg)
+            {
+                encoder.encode(msg.getRawData(), msg.getRawDataSize(), bytes);
+            };
+
+            ApplicationState s;
+            for (auto&& msg : s.collectLine("ch 2 on 60 100 on 64 100 off 60 0"))
+            {
+                encode(msg);
+            }
+            // the note off has a status of its own
+            expect(bytes == std::vector<uint8> { 0x91, 60, 100, 64, 100, 0x81, 60, 0 });
+            expectEquals(encoder.getBytesSaved(), (int64)1);
+
+            // real-time and SysEx both reset it
+            bytes.clear();
+            encode(MidiMessage::noteOff(2, 62, (uint8)0));
+            encode(MidiMessage::midiClock());
+            encode(MidiMessage::noteOff(2, 64, (uint8)0));
+            const uint8 sysex[] = { 0x7e, 0x7f, 0x06, 0x01 };
+            encode(MidiMessage::createSysExMessage(sysex, (int)sizeof(sysex)));
+            encode(MidiMessage::noteOff(2, 65, (uint8)0));
+            encode(MidiMessage::noteOff(2, 67, (uint8)0));
+            expect(bytes == std::vector<uint8> { 62, 0, 0xf8, 0x81, 64, 0, 0xf0, 0x7e, 0x7f, 0x06, 0x01, 0xf7, 0x81, 65, 0, 67, 0 });
+            expectEquals(encoder.getBytesSaved(), (int64)3);
+
+            encoder.reset();
+            bytes.clear();
+            encode(MidiMessage::noteOff(2, 69, (uint8)0));
+            expect(bytes == std::vector<uint8> { 0x81, 69, 0 });
+        }
+
+        beginTest("Fan-out sends every message to each port, a slow port only holding up its own");
+        {
+            // records what it's sent, taking its time for every block when it's slow
+            struct RecordingPort : public MidiPort
+            {
+                RecordingPort(Array<MidiMessage>& sent, int delay) : sent_(sent), delay_(delay) {}
+                void sendMessageNow(const MidiMessage& msg) override { sent_.add(msg); }
+                void sendBlockOfMessagesNow(const MidiBuffer& messages) override
+                {
+                    Thread::sleep(delay_);
+                    for (const auto metadata : messages)
+                    {
+                        sent_.add(metadata.getMessage());
+                    }
+                    received_ += messages.getNumEvents();
+                }
+                bool waitUntilDrained(int) override { return true; }
+                Array<MidiMessage>& sent_;
+                int delay_;
+                std::atomic<int> received_ { 0 };
+            };
+
+            Array<MidiMessage> fast, slow;
+            auto fastPort = std::make_unique<RecordingPort>(fast, 0);
+            auto slowPort = std::make_unique<RecordingPort>(slow, 200);
+            auto& fastReceived = fastPort->received_;
+            auto& slowReceived = slowPort->received_;
+            std::vector<std::unique_ptr<MidiPort>> ports;
+            ports.push_back(std::move(fastPort));
+            ports.push_back(std::move(slowPort));
+            FanOutPort fanOut(std::move(ports));
+            expectEquals(fanOut.getNumPorts(), 2);
+
+            auto messages = ApplicationState().collectLine("on 60 100 cc 74 55 pc 5 off 60 0");
+            for (auto&& msg : messages)
+            {
+                fanOut.sendMessageNow(msg);
+            }
+
+            // the fast port has everything while the slow one is still busy
+            auto start = Time::getMillisecondCounter();
+            while (fastReceived < messages.size() && Time::getMillisecondCounter() - start < 1000)
+            {
+                Thread::sleep(1);
+            }
+            expectEquals(fastReceived.load(), messages.size());
+            expect(slowReceived < messages.size());
+
+            expect(fanOut.waitUntilDrained(5000));
+            expectEquals(slow.size(), messages.size());
+            for (int i = 0; i < messages.size(); ++i)
+            {
+                expect(fast[i].getDescription() == messages[i].getDescription());
+                expect(slow[i].getDescription() == messages[i].getDescription());
+            }
+        }
+
+        beginTest("Send statistics count messages and bytes per kind, with a histogram of their times");
+        {
+            expect(SendStats::kindOf(MidiMessage::noteOn(3, 60, (uint8)100)) == SendStats::NOTE_ON);
+            expect(SendStats::kindOf(MidiMessage::pitchWheel(16, 0)) == SendStats::PITCH_BEND);
+            expect(SendStats::kindOf(MidiMessage::midiClock()) == SendStats::REAL_TIME);
+            expect(SendStats::kindOf(MidiMessage::songPositionPointer(4)) == SendStats::SYSTEM_COMMON);
+
+            SendStats stats;
+            auto micros = [](double us) { return Time::secondsToHighResolutionTicks(us / 1000000.0); };
+            for (int i = 0; i < 99; ++i)
+            {
+                stats.addMessage(MidiMessage::noteOn(1, 60, (uint8)100), micros(1.0));
+            }
+            stats.addMessage(MidiMessage::noteOn(1, 60, (uint8)100), micros(500.0));
+            const uint8 sysex[] = { 0x7e, 0x7f, 0x06, 0x01 };
+            stats.addMessage(MidiMessage::createSysExMessage(sysex, (int)sizeof(sysex)), micros(10.0));
+            stats.addTimestampWait(micros(2000.0));
+
+            expectEquals(stats.getMessageCount(), (int64)101);
+            expectEquals(stats.getByteCount(), (int64)(100 * 3 + 6));
+            expectEquals(stats.getMessageCount(SendStats::NOTE_ON), (int64)100);
+            expectEquals(stats.getMessageCount(SendStats::SYSTEM_EXCLUSIVE), (int64)1);
+            // the percentiles are the upper edges of their power of two buckets
+            expect(stats.getPercentileMicros(SendStats::NOTE_ON, 50.0) >= 1.0);
+            expect(stats.getPercentileMicros(SendStats::NOTE_ON, 99.0) <= 2.1);
+            expectWithinAbsoluteError(stats.getMaximumMicros(SendStats::NOTE_ON), 500.0, 1.0);
+            expectWithinAbsoluteError(stats.getTimestampWaitSeconds(), 0.002, 0.0001);
+
+            auto json = JSON::parse(JSON::toString(stats.toVar(), true));
+            expectEquals((int)json["messages"], 101);
+            expectEquals((int)json["kinds"]["note-on"]["messages"], 100);
+            expectEquals((int)json["kinds"]["system-exclusive"]["bytes"], 6);
+            expectEquals(json["timing"].toString(), String("hand-over"));
+
+            // a send that took no ticks at all
+            SendStats instant;
+            instant.addMessage(MidiMessage::controllerEvent(1, 74, 1), 0);
+            expectEquals(instant.getMessageCount(SendStats::CONTROL_CHANGE), (int64)1);
+            expectEquals(instant.getPercentileMicros(SendStats::CONTROL_CHANGE, 99.0), 0.0);
+        }
+
+        beginTest("With a scheduler, send statistics time the port's sends");
+        {
+            SendStats stats;
+            {
+                // a port that takes a millisecond for every block
+                MidiScheduler scheduler([](const MidiBuffer&) { Thread::sleep(1); }, &stats);
+                auto now = Time::getHighResolutionTicks();
+                scheduler.schedule(MidiMessage::noteOn(1, 60, (uint8)100), now);
+                scheduler.schedule(MidiMessage::controllerEvent(1, 74, 1), now);
+                scheduler.schedule(MidiMessage::noteOn(1, 62, (uint8)100), now + Time::secondsToHighResolutionTicks(0.005));
+                scheduler.flush();
+            }
+            expectEquals(stats.getMessageCount(SendStats::NOTE_ON), (int64)2);
+            expectEquals(stats.getMessageCount(SendStats::CONTROL_CHANGE), (int64)1);
+            expectEquals(stats.getByteCount(), (int64)9);
+            // a message alone in its block takes the whole millisecond, two
+            // together share it
+            expect(stats.getMaximumMicros(SendStats::NOTE_ON) >= 900.0);
+            expect(stats.getMaximumMicros(SendStats::CONTROL_CHANGE) >= 450.0);
+        }
+
+#if JUCE_LINUX || JUCE_MAC
+        beginTest("Served commands run in the client's directory and print there");
+        {
+            auto socket = File::getSpecialLocation(File::tempDirectory).getNonexistentChildFile("sendmidi-test", ".sock", false);
+            auto path = socket.getFullPathName();
+            auto directory = File::getSpecialLocation(File::tempDirectory).getNonexistentChildFile("sendmidi-client", "", false);
+            expect(directory.createDirectory().wasOk());
+            directory.getChildFile("program.txt").replaceWithText("# nothing to send\n");
+
+            ApplicationState server;
+            std::atomic<bool> served { false };
+            std::thread serving([&] { served = CommandServer::serve(server, path); });
+
+            std::ostringstream out, err;
+            auto result = -1;
+            for (int i = 0; i < 500 && result < 0; ++i)
+            {
+                result = CommandServer::forward(path, {}, directory, out, err);
+                if (result < 0)
+                {
+                    Thread::sleep(10);
+                }
+            }
+            expectEquals(result, 0);
+
+            // only the server's user can connect
+            struct stat status;
+            expectEquals(stat(path.toRawUTF8(), &status), 0);
+            expectEquals((int)(status.st_mode & 0077), 0);
+
+            // a client doesn't inherit the settings or the unfinished command
+            // of the one before it
+            expectEquals(CommandServer::forward(path, { "ch 5 nowait din hex cc 4A" }, directory, out, err), 0);
+            expectEquals(CommandServer::forward(path, { "55" }, directory, out, err), 0);
+            expectEquals(server.channel_, 1);
+            expect(!server.noWait_ && !server.dinPort_);
+            expectEquals(String(err.str()), String());
+
+            // and every client is told about the missing output port
+            for (int i = 0; i < 2; ++i)
+            {
+                std::ostringstream missing;
+                expectEquals(CommandServer::forward(path, { "on 60 100" }, directory, out, missing), 1);
+                expectEquals(String(missing.str()), String("No valid MIDI output port was specified for some of the messages\n"));
+            }
+
+            // relative paths are the client's
+            expectEquals(CommandServer::forward(path, { "compile program.txt program.smcp" }, directory, out, err), 0);
+            expect(directory.getChildFile("program.smcp").existsAsFile());
+
+            // errors and output come back with the exit code
+            expectEquals(CommandServer::forward(path, { "file missing.txt" }, directory, out, err), 1);
+            expectEquals(String(err.str()), String("Couldn't find file \"missing.txt\"\n"));
+            String listed;
+            for (auto&& name : server.getOutputDevices().getDisplayNames())
+            {
+                listed << name << "\n";
+            }
+            expectEquals(CommandServer::forward(path, { "list" }, directory, out, err), 0);
+            expectEquals(String(out.str()), listed);
+
+            // a client can stop the server, which then cleans up its socket
+            expectEquals(CommandServer::forward(path, { CommandServer::STOP_REQUEST }, directory, out, err), 0);
+            serving.join();
+            expect(served);
+            expect(!socket.exists());
+            expectEquals(CommandServer::forward(path, {}, directory, out, err), -1);
+
+            // a file that isn't a socket isn't replaced by one
+            socket.replaceWithText("keep me\n");
+            expect(!CommandServer::serve(server, path));
+            expectEquals(socket.loadFileAsString(), String("keep me\n"));
+            socket.deleteFile();
+            directory.deleteRecursively();
+        }
+#endif
+
+#if ! JUCE_WINDOWS
+        beginTest("Standard input is read ahead in chunks and split into lines");
+        {
+            int fds[2];
+            expectEquals(pipe(fds), 0);
+
+            // tiny chunks, so that lines straddle them
+            {
+                const char* input = "on 60 100\ncc 1 2\r\n\nsyx 1 2 3 4 5 6 7 8 9\nlast";
+                expect(write(fds[1], input, std::strlen(input)) == (ssize_t)std::strlen(input));
+                close(fds[1]);
+
+                StdinReader reader(fds[0], 4, 3);
+                StringArray lines;
+                std::string line;
+                while (reader.nextLine(line))
+                {
+                    lines.add(String(line));
+                }
+                expect(lines == StringArray({ "on 60 100", "cc 1 2\r", "", "syx 1 2 3 4 5 6 7 8 9", "last" }));
+                expect(!reader.nextLine(line));
+                close(fds[0]);
+            }
+
+            // a megabyte is taken in while nothing is parsed, far more than
+            // the pipe itself holds, so the writer isn't held up
+            expectEquals(pipe(fds), 0);
+            {
+                StdinReader reader(fds[0]);
+                std::string text;
+                for (int i = 0; i < 65536; ++i)
+                {
+                    text += "on 60 100 cc 1\n";
+                }
+                size_t written = 0;
+                while (written < text.size())
+                {
+                    auto result = write(fds[1], text.data() + written, text.size() - written);
+                    if (result <= 0)
+                    {
+                        break;
+                    }
+                    written += (size_t)result;
+                }
+                expectEquals((int64)written, (int64)text.size());
+                close(fds[1]);
+
+                int count = 0;
+                std::string line;
+                auto intact = true;
+                while (reader.nextLine(line))
+                {
+                    intact = intact && line == "on 60 100 cc 1";
+                    count += 1;
+                }
+                expectEquals(count, 65536);
+                expect(intact);
+                close(fds[0]);
+            }
+        }
+#endif
+
+        beginTest("Channel voice commands don't allocate once they're running");
+        {
+            ApplicationState s;
+            Array<MidiMessage> sink;
+            sink.ensureStorageAllocated(64);
+
+            // the line is tokenized in place, so every run gets a fresh copy
+            const char* program = "ch 3 on 60 100 off C4 0 pp Db3 50 cc 74 55 cc14 1 8192 pc 12 cp 90 "
+                                  "pb 8192 pb -1/2 nrpn 245 1 rpn 0 2 hex cc 4AH 7f dec omc 3";
+            std::vector<char> line(program, program + std::strlen(program) + 1);
+            auto run = [&]
+            {
+                std::memcpy(line.data(), program, line.size());
+                sink.clearQuick();
+                s.collectLine(line.data(), sink);
+            };
+
+            run();
+            auto messages = sink.size();
+            expectEquals(messages, 23);
+
+            countingAllocations = true;
+            allocationsCounted = 0;
+            for (int i = 0; i < 100; ++i)
+            {
+                run();
+            }
+            countingAllocations = false;
+
+            expectEquals(allocationsCounted, (int64)0);
+            expectEquals(sink.size(), messages);
+        }
+
         beginTest("Channel, octave and hex settings carry across a command line");
         {
             // the channel set earlier applies to later messages